@@ -0,0 +1,74 @@
+#ifndef AUTO_BUFFER_H_
+#define AUTO_BUFFER_H_
+
+// Compile-time choice of the new_buffer specialization, so that users do not have to pick one of the magic
+// INITIAL_SIZE values by hand:
+//
+//     auto_buffer<T, EXPECTED_SIZE, FOOTPRINT_BUDGET[, SZ]>
+//
+// resolves to new_buffer<T, SZ, N> with the first of these layouts that applies:
+//  1. inline (N = EXPECTED_SIZE), if EXPECTED_SIZE elements can be stored in an object of at most FOOTPRINT_BUDGET bytes
+//  2. header in heap (N = 0), if FOOTPRINT_BUDGET cannot even hold a pointer, a size and a capacity
+//  3. usable size (N = -2), if T is smaller than the 16-byte spacing of the small size classes of glibc, jemalloc and
+//     tcmalloc, so that the slack left by rounding a block up to its size class is likely to hold further elements
+//  4. local header (N = -1) otherwise, which has the same footprint, but does not query the usable size of every block
+//     it allocates for slack that cannot hold a single element
+// auto_buffer_selector exposes the decision, e.g., auto_buffer_selector<unsigned, unsigned, 8, 64>::describe().
+
+#include "new_buffer.h"
+
+#include <cstddef>
+#include <string>
+
+enum class new_buffer_layout {
+    inline_buffer,
+    header_in_heap,
+    local_header,
+    usable_size,
+};
+
+constexpr char const* new_buffer_layout_name(new_buffer_layout layout) {
+    return layout == new_buffer_layout::inline_buffer ? "inline"
+        : layout == new_buffer_layout::header_in_heap ? "header-in-heap"
+        : layout == new_buffer_layout::local_header ? "local-header"
+        : "usable-size";
+}
+
+template<typename T, typename SZ, std::size_t EXPECTED_SIZE, std::size_t FOOTPRINT_BUDGET>
+struct auto_buffer_selector {
+    // computed rather than taken from sizeof(new_buffer<T, SZ, EXPECTED_SIZE>), which would fail to compile for
+    // expected sizes that do not fit SZ
+    static constexpr std::size_t local_header_footprint = sizeof(new_buffer<T, SZ, static_cast<std::size_t>(-1)>);
+    static constexpr std::size_t inline_footprint = EXPECTED_SIZE > (FOOTPRINT_BUDGET / sizeof(T)) ? FOOTPRINT_BUDGET + 1
+        : (local_header_footprint + EXPECTED_SIZE * sizeof(T) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+    static constexpr std::size_t size_class_spacing = 16;
+
+    static constexpr new_buffer_layout layout = EXPECTED_SIZE > 0 && static_cast<SZ>(EXPECTED_SIZE) == EXPECTED_SIZE && inline_footprint <= FOOTPRINT_BUDGET ? new_buffer_layout::inline_buffer
+        : FOOTPRINT_BUDGET < local_header_footprint ? new_buffer_layout::header_in_heap
+        : sizeof(T) < size_class_spacing ? new_buffer_layout::usable_size
+        : new_buffer_layout::local_header;
+
+    static constexpr std::size_t initial_size = layout == new_buffer_layout::inline_buffer ? EXPECTED_SIZE
+        : layout == new_buffer_layout::header_in_heap ? 0
+        : layout == new_buffer_layout::local_header ? static_cast<std::size_t>(-1)
+        : static_cast<std::size_t>(-2);
+
+    using type = new_buffer<T, SZ, initial_size>;
+
+    static constexpr char const* name = new_buffer_layout_name(layout);
+
+    // e.g., "inline<8> (48 bytes)"
+    static std::string describe() {
+        std::string result = name;
+        if(layout == new_buffer_layout::inline_buffer) {
+            result += "<" + std::to_string(EXPECTED_SIZE) + ">";
+        }
+        return result + " (" + std::to_string(sizeof(type)) + " bytes)";
+    }
+};
+
+template<typename T, std::size_t EXPECTED_SIZE, std::size_t FOOTPRINT_BUDGET, typename SZ = unsigned>
+using auto_buffer = typename auto_buffer_selector<T, SZ, EXPECTED_SIZE, FOOTPRINT_BUDGET>::type;
+
+#endif /* AUTO_BUFFER_H_ */
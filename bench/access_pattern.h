@@ -0,0 +1,177 @@
+#pragma once
+
+// Index streams for the random access benchmarks. The indices are generated before the timed loop, so that the loop
+// measures the container and not the PRNG, which otherwise takes most of the time of an access at small sizes.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+enum class access_pattern : int {
+	uniform,
+	zipfian, // exponent 0.99 as in YCSB, with the ranks scattered over the buffer
+	sequential,
+	strided, // every access touches a new cache line of 4-byte elements
+	hot_set, // 90% of the accesses go to a contiguous tenth of the buffer
+	pointer_chase, // a random cycle, along which every element is visited once per lap
+};
+
+static constexpr int access_pattern_count = 6;
+
+inline char const* access_pattern_name(access_pattern pattern) noexcept {
+	switch(pattern) {
+		case access_pattern::uniform: return "uniform";
+		case access_pattern::zipfian: return "zipfian";
+		case access_pattern::sequential: return "sequential";
+		case access_pattern::strided: return "strided";
+		case access_pattern::hot_set: return "hot_set";
+		case access_pattern::pointer_chase: return "pointer_chase";
+	}
+	return "unknown";
+}
+
+// Zipf distribution over [1, n] by rejection-inversion (Hörmann and Derflinger, 1996), which takes constant time and
+// memory per sample, unlike the zeta-based generators that have to sum over all n ranks up front.
+class zipf_distribution {
+	double m_exponent;
+	double m_h_integral_x1;
+	double m_h_integral_n;
+	double m_s;
+	std::uint64_t m_n;
+
+	static double helper1(double x) noexcept { return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x / 2; }
+	static double helper2(double x) noexcept { return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x / 2; }
+
+	double h(double x) const noexcept { return std::exp(-m_exponent * std::log(x)); }
+	double h_integral(double x) const noexcept {
+		double const log_x = std::log(x);
+		return helper2((1 - m_exponent) * log_x) * log_x;
+	}
+	double h_integral_inverse(double x) const noexcept {
+		double const t = std::max(x * (1 - m_exponent), -1.0);
+		return std::exp(helper1(t) * x);
+	}
+
+public:
+	zipf_distribution(std::uint64_t n, double exponent) : m_exponent(exponent), m_n(n) {
+		m_h_integral_x1 = h_integral(1.5) - 1;
+		m_h_integral_n = h_integral(static_cast<double>(n) + 0.5);
+		m_s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+	}
+
+	template<typename Generator>
+	std::uint64_t operator()(Generator& prng) {
+		std::uniform_real_distribution<double> unit;
+		for(;;) {
+			double const u = m_h_integral_n + unit(prng) * (m_h_integral_x1 - m_h_integral_n);
+			double const x = h_integral_inverse(u);
+			double const k = std::min(std::max(std::floor(x + 0.5), 1.0), static_cast<double>(m_n));
+			if(k - x <= m_s || u >= h_integral(k + 0.5) - h(k)) {
+				return static_cast<std::uint64_t>(k);
+			}
+		}
+	}
+};
+
+// A stream of indices into a buffer of `size` elements, handed out in windows of `window` consecutive accesses. The
+// stream repeats after `period` accesses; for the sequential and strided patterns, 1<<22 indices cover 16 MiB of 4-byte
+// elements, which is more than most last-level caches.
+class access_stream {
+public:
+	static constexpr std::size_t default_period = 1 << 22;
+	static constexpr std::size_t stride = 16;
+
+private:
+	std::vector<std::uint32_t> m_indices; // period + window, so that every window is contiguous
+	std::size_t m_period;
+	std::size_t m_window;
+	std::size_t m_offset = 0;
+
+	template<typename Generator>
+	static std::vector<std::uint32_t> generate(access_pattern pattern, std::size_t size, std::size_t period, Generator& prng) {
+		std::vector<std::uint32_t> result(period);
+		std::uniform_int_distribution<std::uint32_t> index_distribution(0, static_cast<std::uint32_t>(size - 1));
+		switch(pattern) {
+			case access_pattern::uniform:
+				for(auto& index : result) {
+					index = index_distribution(prng);
+				}
+				break;
+			case access_pattern::zipfian: {
+				// an affine map with a prime factor larger than any size is a bijection that spreads out the hot ranks
+				zipf_distribution zipf(size, 0.99);
+				for(auto& index : result) {
+					index = static_cast<std::uint32_t>((zipf(prng) - 1) * 2654435761ull % size);
+				}
+				break;
+			}
+			case access_pattern::sequential:
+				for(std::size_t i = 0; i < period; ++i) {
+					result[i] = static_cast<std::uint32_t>(i % size);
+				}
+				break;
+			case access_pattern::strided: {
+				std::size_t const lanes = std::min(stride, size);
+				std::size_t lane = 0;
+				std::size_t position = 0;
+				for(auto& index : result) {
+					index = static_cast<std::uint32_t>(position);
+					position += stride;
+					if(position >= size) {
+						lane = (lane + 1) % lanes;
+						position = lane;
+					}
+				}
+				break;
+			}
+			case access_pattern::hot_set: {
+				std::size_t const hot_size = std::max<std::size_t>(size / 10, 1);
+				std::size_t const hot_begin = std::uniform_int_distribution<std::size_t>(0, size - hot_size)(prng);
+				std::uniform_int_distribution<std::uint32_t> hot_distribution(static_cast<std::uint32_t>(hot_begin), static_cast<std::uint32_t>(hot_begin + hot_size - 1));
+				std::bernoulli_distribution hot(0.9);
+				for(auto& index : result) {
+					index = hot(prng) ? hot_distribution(prng) : index_distribution(prng);
+				}
+				break;
+			}
+			case access_pattern::pointer_chase:
+				// one element from each of `period` equal segments, visited in random order; for buffers of at most
+				// `period` elements, that is a random permutation of all of them
+				for(std::size_t i = 0; i < period; ++i) {
+					std::size_t const begin = i * size / period;
+					std::size_t const end = (i + 1) * size / period;
+					result[i] = static_cast<std::uint32_t>(std::uniform_int_distribution<std::size_t>(begin, end - 1)(prng));
+				}
+				std::shuffle(result.begin(), result.end(), prng);
+				break;
+		}
+		return result;
+	}
+
+public:
+	template<typename Generator>
+	access_stream(access_pattern pattern, std::size_t size, std::size_t window, Generator& prng)
+		: m_period(pattern == access_pattern::pointer_chase ? std::min(size, default_period) : default_period), m_window(window) {
+		m_indices = generate(pattern, size, m_period, prng);
+		m_indices.reserve(m_period + m_window);
+		for(std::size_t i = 0; i < m_window; ++i) {
+			m_indices.push_back(m_indices[i % m_period]);
+		}
+	}
+
+	std::size_t period() const noexcept { return m_period; }
+	std::size_t window() const noexcept { return m_window; }
+
+	// the first `period` indices, i.e., for pointer_chase, the cycle in the order in which it is visited
+	std::uint32_t const* indices() const noexcept { return m_indices.data(); }
+
+	// the `window` indices of the next accesses
+	std::uint32_t const* next() noexcept {
+		std::uint32_t const* const result = m_indices.data() + m_offset;
+		m_offset = (m_offset + m_window) % m_period;
+		return result;
+	}
+};
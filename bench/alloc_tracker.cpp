@@ -0,0 +1,228 @@
+// Interposing allocation tracker.
+//
+// Either link this file into the benchmark binary, or build it as a shared object and LD_PRELOAD it:
+//   c++ -std=c++11 -O2 -fPIC -shared bench/alloc_tracker.cpp -o alloc_tracker.so -ldl
+//
+// Every entry point forwards to the next definition in symbol lookup order (RTLD_NEXT), so the tracker works in front of
+// glibc as well as in front of jemalloc or tcmalloc.
+
+#define ALLOC_TRACKER_IMPLEMENTATION
+#include "alloc_tracker.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <dlfcn.h>
+
+namespace {
+	struct next_functions {
+		void* (*malloc)(std::size_t);
+		void* (*calloc)(std::size_t, std::size_t);
+		void* (*realloc)(void*, std::size_t);
+		void (*free)(void*);
+		void (*sdallocx)(void*, std::size_t, int); // only provided by jemalloc
+		int (*posix_memalign)(void**, std::size_t, std::size_t);
+		void* (*aligned_alloc)(std::size_t, std::size_t);
+		void* (*memalign)(std::size_t, std::size_t);
+		std::size_t (*malloc_usable_size)(void*);
+	};
+
+	next_functions next;
+	bool initializing = false;
+
+	// dlsym may allocate, so allocations performed during initialization are served from this arena and never freed
+	alignas(alignof(std::max_align_t)) char bootstrap_arena[4096];
+	std::size_t bootstrap_used = 0;
+
+	// initial-exec, as the general dynamic TLS model may call malloc on first access
+	__attribute__((tls_model("initial-exec"))) thread_local alloc_tracker_stats stats;
+
+	template<typename F>
+	void resolve(F& function, char const* name) {
+		function = reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+	}
+
+	void initialize() {
+		initializing = true;
+		resolve(next.calloc, "calloc");
+		resolve(next.realloc, "realloc");
+		resolve(next.free, "free");
+		resolve(next.sdallocx, "sdallocx");
+		resolve(next.posix_memalign, "posix_memalign");
+		resolve(next.aligned_alloc, "aligned_alloc");
+		resolve(next.memalign, "memalign");
+		resolve(next.malloc_usable_size, "malloc_usable_size");
+		resolve(next.malloc, "malloc"); // last, as it doubles as the "initialized" flag
+		initializing = false;
+	}
+
+	// `alignment` has to be a power of two; smaller alignments than that of std::max_align_t are rounded up to it
+	void* bootstrap_allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t)) {
+		if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+			return nullptr;
+		}
+		if(alignment < alignof(std::max_align_t)) {
+			alignment = alignof(std::max_align_t);
+		}
+		std::uintptr_t const base = reinterpret_cast<std::uintptr_t>(bootstrap_arena);
+		std::size_t const offset = ((base + bootstrap_used + alignment - 1) & ~static_cast<std::uintptr_t>(alignment - 1)) - base;
+		std::size_t const aligned = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		if(aligned < size || offset > sizeof(bootstrap_arena) || aligned > sizeof(bootstrap_arena) - offset) {
+			return nullptr;
+		}
+		void* const result = bootstrap_arena + offset;
+		bootstrap_used = offset + aligned;
+		return result; // static storage, thus already zeroed for calloc
+	}
+
+	bool is_bootstrap(void const* ptr) {
+		return ptr >= static_cast<void const*>(bootstrap_arena) && ptr < static_cast<void const*>(bootstrap_arena + sizeof(bootstrap_arena));
+	}
+
+	// returns true if the caller has to serve the request from the bootstrap arena
+	bool ensure_initialized() {
+		if(next.malloc == nullptr) {
+			if(initializing) {
+				return true;
+			}
+			initialize();
+		}
+		return false;
+	}
+
+	std::int64_t usable_size(void* ptr) {
+		return ptr ? static_cast<std::int64_t>(next.malloc_usable_size(ptr)) : 0;
+	}
+
+	void add_live(std::int64_t bytes) {
+		stats.live_bytes += bytes;
+		if(stats.live_bytes > stats.peak_bytes) {
+			stats.peak_bytes = stats.live_bytes;
+		}
+	}
+
+	void* track_allocation(void* ptr) {
+		if(ptr) {
+			++stats.mallocs;
+			add_live(usable_size(ptr));
+		}
+		return ptr;
+	}
+
+	void track_deallocation(void* ptr) {
+		++stats.frees;
+		stats.live_bytes -= usable_size(ptr);
+	}
+}
+
+extern "C" {
+	alloc_tracker_stats* alloc_tracker_thread_stats() { return &stats; }
+
+	void* malloc(std::size_t size) {
+		if(ensure_initialized()) {
+			return bootstrap_allocate(size);
+		}
+		return track_allocation(next.malloc(size));
+	}
+
+	void* calloc(std::size_t count, std::size_t size) {
+		if(ensure_initialized()) {
+			if(size != 0 && count > std::numeric_limits<std::size_t>::max() / size) {
+				return nullptr;
+			}
+			return bootstrap_allocate(count * size);
+		}
+		return track_allocation(next.calloc(count, size));
+	}
+
+	void* realloc(void* ptr, std::size_t size) {
+		if(ensure_initialized()) {
+			// blocks are handed out in increasing order, so the old one (if any) ends before the new one starts
+			void* const result = bootstrap_allocate(size);
+			if(result && ptr) {
+				std::size_t const available = static_cast<std::size_t>(static_cast<char*>(result) - static_cast<char*>(ptr));
+				std::memcpy(result, ptr, size < available ? size : available);
+			}
+			return result;
+		}
+		if(is_bootstrap(ptr)) {
+			void* const result = track_allocation(next.malloc(size));
+			if(result) {
+				std::size_t const available = static_cast<std::size_t>(bootstrap_arena + sizeof(bootstrap_arena) - static_cast<char*>(ptr));
+				std::memcpy(result, ptr, size < available ? size : available);
+			}
+			return result;
+		}
+		if(ptr == nullptr) {
+			return track_allocation(next.realloc(ptr, size));
+		}
+
+		std::int64_t const old_size = usable_size(ptr);
+		void* const result = next.realloc(ptr, size);
+		if(result) {
+			++stats.reallocs;
+			if(result != ptr) {
+				++stats.realloc_moves;
+			}
+			add_live(usable_size(result) - old_size);
+		} else if(size == 0) {
+			++stats.frees;
+			stats.live_bytes -= old_size;
+		}
+		return result;
+	}
+
+	void free(void* ptr) {
+		if(ptr == nullptr || is_bootstrap(ptr)) {
+			return;
+		}
+		track_deallocation(ptr);
+		next.free(ptr);
+	}
+
+	void sdallocx(void* ptr, std::size_t size, int flags) {
+		if(is_bootstrap(ptr)) {
+			return;
+		}
+		ensure_initialized();
+		track_deallocation(ptr);
+		if(next.sdallocx) {
+			next.sdallocx(ptr, size, flags);
+		} else {
+			next.free(ptr);
+		}
+	}
+
+	int posix_memalign(void** result, std::size_t alignment, std::size_t size) {
+		if(ensure_initialized()) {
+			void* const block = bootstrap_allocate(size, alignment);
+			if(!block) {
+				return alignment == 0 || (alignment & (alignment - 1)) != 0 ? EINVAL : ENOMEM;
+			}
+			*result = block;
+			return 0;
+		}
+		int const error = next.posix_memalign(result, alignment, size);
+		if(error == 0) {
+			track_allocation(*result);
+		}
+		return error;
+	}
+
+	void* aligned_alloc(std::size_t alignment, std::size_t size) {
+		if(ensure_initialized()) {
+			return bootstrap_allocate(size, alignment);
+		}
+		return track_allocation(next.aligned_alloc(alignment, size));
+	}
+
+	void* memalign(std::size_t alignment, std::size_t size) {
+		if(ensure_initialized()) {
+			return bootstrap_allocate(size, alignment);
+		}
+		return track_allocation(next.memalign(alignment, size));
+	}
+}
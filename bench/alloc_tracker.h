@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Counters maintained by the interposing allocation tracker (alloc_tracker.cpp), which is either linked into the
+// benchmark or LD_PRELOADed. The tracker sits in front of whatever malloc implementation is in use (glibc, jemalloc,
+// tcmalloc), so these counters mean the same thing in every allocator configuration.
+//
+// All counters are thread-local: an allocation is attributed to the thread that performed it and a deallocation to the
+// thread that performed the deallocation. Byte counts are based on malloc_usable_size.
+struct alloc_tracker_stats {
+	std::int64_t live_bytes; // may become negative in threads that free memory that was allocated elsewhere
+	std::int64_t peak_bytes;
+	std::uint64_t mallocs; // malloc, calloc, posix_memalign, aligned_alloc, memalign and realloc(nullptr, n)
+	std::uint64_t reallocs;
+	std::uint64_t realloc_moves; // reallocs that could not be satisfied in place
+	std::uint64_t frees; // free, sdallocx and realloc(ptr, 0)
+};
+
+#if defined(ALLOC_TRACKER_IMPLEMENTATION)
+extern "C" alloc_tracker_stats* alloc_tracker_thread_stats();
+#else
+// weak, so that binaries without the tracker still link and can check for it at runtime
+extern "C" alloc_tracker_stats* alloc_tracker_thread_stats() __attribute__((weak));
+
+namespace alloc_tracker {
+	inline bool available() noexcept { return alloc_tracker_thread_stats != nullptr; }
+
+	inline alloc_tracker_stats snapshot() noexcept {
+		if(available()) {
+			return *alloc_tracker_thread_stats();
+		}
+		return alloc_tracker_stats();
+	}
+
+	// starts a new peak measurement from the current number of live bytes
+	inline void reset_peak() noexcept {
+		if(available()) {
+			alloc_tracker_stats* const stats = alloc_tracker_thread_stats();
+			stats->peak_bytes = stats->live_bytes;
+		}
+	}
+}
+#endif
@@ -0,0 +1,127 @@
+#pragma once
+
+// Process-wide statistics of the malloc implementation in use. These are expensive to gather (jemalloc has to refresh its
+// epoch, glibc walks all arenas), so they should only be sampled outside of timed regions.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+#if defined(JEMALLOC) && JEMALLOC
+#include <jemalloc/jemalloc.h>
+#elif defined(TCMALLOC) && TCMALLOC
+#include <gperftools/malloc_extension.h>
+#else
+#include <malloc.h>
+#endif
+
+struct allocator_stats {
+	std::size_t allocated; // bytes in live allocations (as seen by the allocator, i.e., including size class rounding)
+	std::size_t active; // bytes in pages that contain live allocations
+	std::size_t resident; // bytes of physically resident memory, including metadata and cached free pages
+	std::size_t mapped; // bytes of address space mapped by the allocator
+	std::size_t metadata; // bytes used for the allocator's bookkeeping
+	std::size_t retained; // bytes of address space kept around without being mapped or resident
+	std::size_t thread_cache; // bytes of free memory held in thread caches
+
+	// Resident bytes per allocated byte. 1 would be perfect; growth policies that leave holes push this up. NaN without
+	// any allocations, in which case it should not be reported (it is plotted on a log scale).
+	double fragmentation() const noexcept {
+		return allocated == 0 ? std::numeric_limits<double>::quiet_NaN() : static_cast<double>(resident) / static_cast<double>(allocated);
+	}
+
+	static allocator_stats take() noexcept;
+};
+
+#if defined(JEMALLOC) && JEMALLOC
+namespace allocator_stats_detail {
+	inline std::size_t mallctl_size(char const* name) noexcept {
+		std::size_t value = 0;
+		std::size_t size = sizeof(value);
+		if(mallctl(name, &value, &size, nullptr, 0)) {
+			return 0;
+		}
+		return value;
+	}
+}
+
+static constexpr bool allocator_stats_available = true;
+
+inline allocator_stats allocator_stats::take() noexcept {
+	using allocator_stats_detail::mallctl_size;
+
+	// statistics are only refreshed when the epoch is advanced
+	std::uint64_t epoch = 1;
+	std::size_t size = sizeof(epoch);
+	mallctl("epoch", &epoch, &size, &epoch, size);
+
+	allocator_stats result;
+	result.allocated = mallctl_size("stats.allocated");
+	result.active = mallctl_size("stats.active");
+	result.resident = mallctl_size("stats.resident");
+	result.mapped = mallctl_size("stats.mapped");
+	result.metadata = mallctl_size("stats.metadata");
+	result.retained = mallctl_size("stats.retained");
+	char name[64];
+	std::snprintf(name, sizeof(name), "stats.arenas.%u.tcache_bytes", static_cast<unsigned>(MALLCTL_ARENAS_ALL));
+	result.thread_cache = mallctl_size(name);
+	return result;
+}
+#elif defined(TCMALLOC) && TCMALLOC
+namespace allocator_stats_detail {
+	// the properties are read one after another, so they need not be consistent with each other
+	inline std::size_t saturating_sub(std::size_t lhs, std::size_t rhs) noexcept { return lhs > rhs ? lhs - rhs : 0; }
+
+	inline std::size_t tcmalloc_property(char const* name) noexcept {
+		std::size_t value = 0;
+		MallocExtension::instance()->GetNumericProperty(name, &value);
+		return value;
+	}
+}
+
+static constexpr bool allocator_stats_available = true;
+
+inline allocator_stats allocator_stats::take() noexcept {
+	using allocator_stats_detail::saturating_sub;
+	using allocator_stats_detail::tcmalloc_property;
+
+	std::size_t const heap = tcmalloc_property("generic.heap_size");
+	std::size_t const unmapped = tcmalloc_property("tcmalloc.pageheap_unmapped_bytes");
+	std::size_t const free_bytes = tcmalloc_property("tcmalloc.pageheap_free_bytes");
+	std::size_t const physical = tcmalloc_property("generic.total_physical_bytes");
+
+	allocator_stats result;
+	result.allocated = tcmalloc_property("generic.current_allocated_bytes");
+	result.active = saturating_sub(saturating_sub(heap, unmapped), free_bytes);
+	result.resident = physical;
+	result.mapped = saturating_sub(heap, unmapped);
+	result.metadata = saturating_sub(physical, result.mapped);
+	result.retained = unmapped;
+	result.thread_cache = tcmalloc_property("tcmalloc.current_total_thread_cache_bytes");
+	return result;
+}
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+static constexpr bool allocator_stats_available = true;
+
+// glibc does not distinguish resident from mapped memory, nor does it report its per-thread tcache
+inline allocator_stats allocator_stats::take() noexcept {
+	struct mallinfo2 const info = mallinfo2();
+
+	allocator_stats result;
+	result.allocated = info.uordblks + info.hblkhd;
+	result.active = result.allocated;
+	result.resident = info.arena + info.hblkhd;
+	result.mapped = info.arena + info.hblkhd;
+	result.metadata = 0;
+	result.retained = 0;
+	result.thread_cache = 0;
+	return result;
+}
+#else
+static constexpr bool allocator_stats_available = false;
+
+inline allocator_stats allocator_stats::take() noexcept {
+	return allocator_stats();
+}
+#endif
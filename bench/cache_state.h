@@ -0,0 +1,195 @@
+#pragma once
+
+// Controls the cache state in which the iterations of a benchmark start, selected by $CACHE_MODE:
+// - "warm" (default): whatever the previous iteration left behind, which for small buffers means everything is cached
+// - "flushed": the registered ranges are evicted from all cache levels with clflush (dc civac on arm64), so that only
+//   the accesses to the benchmarked buffers miss, while the allocator and the stack stay warm
+// - "thrashed": a scratch buffer of twice the size of the last-level cache ($CACHE_THRASH_BYTES overrides it) is read
+//   before every iteration, which evicts everything, as when the buffers are touched again after unrelated work
+//
+// The eviction runs outside of the timed region; since pausing the timers costs on the order of 2 us, the cold modes
+// time every iteration with steady_clock and report it through manual timing instead, so the benchmarks that use them
+// have to be registered with `cache_state::timing`. As the iteration count would otherwise be picked by the timed part
+// alone, which can be orders of magnitude shorter than the eviction, cold benchmarks run a fixed number of iterations:
+// $CACHE_ITERATIONS, 100 by default.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#endif
+
+enum class cache_mode {
+	warm,
+	flushed,
+	thrashed,
+};
+
+inline char const* cache_mode_name(cache_mode mode) noexcept {
+	switch(mode) {
+		case cache_mode::warm: return "warm";
+		case cache_mode::flushed: return "flushed";
+		case cache_mode::thrashed: return "thrashed";
+	}
+	return "unknown";
+}
+
+class cache_state {
+	struct range {
+		char const* data;
+		std::size_t bytes;
+	};
+
+	static constexpr std::size_t line_bytes = 64;
+
+	benchmark::State& m_state;
+	std::vector<range> m_ranges;
+
+	static cache_mode read_mode() {
+		char const* const text = std::getenv("CACHE_MODE");
+		if(!text || std::strcmp(text, "warm") == 0) {
+			return cache_mode::warm;
+		} else if(std::strcmp(text, "flushed") == 0) {
+			return cache_mode::flushed;
+		} else if(std::strcmp(text, "thrashed") == 0) {
+			return cache_mode::thrashed;
+		}
+		std::fprintf(stderr, "unknown $CACHE_MODE '%s', using warm caches\n", text);
+		return cache_mode::warm;
+	}
+
+	static benchmark::IterationCount cold_iterations() {
+		char const* const text = std::getenv("CACHE_ITERATIONS");
+		long long const iterations = text ? std::strtoll(text, nullptr, 10) : 0;
+		return iterations > 0 ? static_cast<benchmark::IterationCount>(iterations) : 100;
+	}
+
+	static std::size_t thrash_bytes() {
+		char const* const text = std::getenv("CACHE_THRASH_BYTES");
+		long long const bytes = text ? std::strtoll(text, nullptr, 10) : 0;
+		if(bytes > 0) {
+			return static_cast<std::size_t>(bytes);
+		}
+		long const llc_bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+		return 2 * (llc_bytes > 0 ? static_cast<std::size_t>(llc_bytes) : std::size_t(32) << 20);
+	}
+
+	// never destroyed, and written once so that its pages are backed by memory instead of the shared zero page
+	static std::vector<unsigned char> const& scratch() {
+		static std::vector<unsigned char> const* const result = new std::vector<unsigned char>(thrash_bytes(), 1);
+		return *result;
+	}
+
+	static void flush(char const* data, std::size_t bytes) noexcept {
+		char const* const end = data + bytes;
+		data -= reinterpret_cast<std::uintptr_t>(data) % line_bytes;
+		for(; data < end; data += line_bytes) {
+#if defined(__x86_64__) || defined(__i386__)
+			_mm_clflush(data);
+#elif defined(__aarch64__)
+			asm volatile("dc civac, %0" : : "r"(data) : "memory");
+#endif
+		}
+#if defined(__x86_64__) || defined(__i386__)
+		_mm_mfence();
+#elif defined(__aarch64__)
+		asm volatile("dsb ish" : : : "memory");
+#endif
+	}
+
+	static void thrash() noexcept {
+		std::vector<unsigned char> const& buffer = scratch();
+		unsigned sum = 0;
+		for(std::size_t i = 0; i < buffer.size(); i += line_bytes) {
+			sum += buffer[i];
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+
+	void prepare() noexcept {
+		if(mode() == cache_mode::thrashed) {
+			thrash();
+		} else if(mode() == cache_mode::flushed) {
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+			for(range const& it : m_ranges) {
+				flush(it.data, it.bytes);
+			}
+#else
+			thrash(); // no user-space cache line flush
+#endif
+		}
+	}
+
+public:
+	static cache_mode mode() {
+		static cache_mode const result = read_mode();
+		return result;
+	}
+
+	// to be applied to every benchmark that uses a cache_state
+	static void timing(benchmark::internal::Benchmark* family) {
+		if(mode() != cache_mode::warm) {
+			family->UseManualTime()->Iterations(cold_iterations());
+		}
+	}
+
+	// labels the benchmark with the mode, after `label` if that is not empty
+	explicit cache_state(benchmark::State& state, std::string const& label = std::string()) : m_state(state) {
+		state.SetLabel(label.empty() ? std::string(cache_mode_name(mode())) : label + ", " + cache_mode_name(mode()));
+		if(mode() == cache_mode::thrashed) {
+			scratch();
+		}
+	}
+
+	cache_state(cache_state const&) = delete;
+	cache_state& operator=(cache_state const&) = delete;
+
+	void add(void const* data, std::size_t bytes) { m_ranges.push_back(range{ static_cast<char const*>(data), bytes }); }
+
+	// the buffer object and its elements, including the 16 bytes in front of them, which hold the header of the 0
+	// layout (or malloc's chunk header)
+	template<typename Buffer>
+	void add_buffer(Buffer const& buffer) {
+		add(&buffer, sizeof(buffer));
+		if(buffer.size() == 0) {
+			return; // the elements may not even be mapped
+		}
+		add(reinterpret_cast<char const*>(buffer.begin()) - 16, 16 + buffer.size() * sizeof(*buffer.begin()));
+	}
+
+	// Evicts the caches as configured when constructed, and reports the time until it is destroyed as the time of
+	// the iteration; does nothing with warm caches.
+	class iteration {
+		cache_state& m_cache;
+		std::chrono::steady_clock::time_point m_start;
+
+	public:
+		explicit iteration(cache_state& cache) noexcept : m_cache(cache) {
+			if(mode() != cache_mode::warm) {
+				m_cache.prepare();
+				m_start = std::chrono::steady_clock::now();
+			}
+		}
+
+		iteration(iteration const&) = delete;
+		iteration& operator=(iteration const&) = delete;
+
+		~iteration() {
+			if(mode() != cache_mode::warm) {
+				std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - m_start;
+				m_cache.m_state.SetIterationTime(elapsed.count());
+			}
+		}
+	};
+};
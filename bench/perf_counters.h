@@ -0,0 +1,124 @@
+#pragma once
+
+// linux-specific: hardware performance counters via perf_event_open(2)
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// A group of hardware counters that is scheduled onto the PMU as a unit, so that all values cover the same interval.
+// Events that cannot be opened (missing hardware support, perf_event_paranoid, seccomp, ...) are silently dropped;
+// if not even the group leader can be opened, the group is empty and `start`/`stop` do nothing.
+class perf_counter_group {
+public:
+	static constexpr std::size_t max_events = 6;
+
+private:
+	struct event_t {
+		char const* name;
+		std::uint32_t type;
+		std::uint64_t config;
+	};
+
+	static constexpr std::uint64_t cache_event(std::uint64_t cache, std::uint64_t op, std::uint64_t result) {
+		return cache | (op << 8) | (result << 16);
+	}
+
+	static event_t const* events() {
+		static event_t const result[max_events] = {
+			{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ "L1D_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+			{ "LLC_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+			{ "dTLB_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+			{ "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		};
+		return result;
+	}
+
+	int m_leader = -1;
+	std::size_t m_count = 0;
+	int m_fds[max_events];
+	char const* m_names[max_events];
+	double m_values[max_events];
+
+	static int open_event(event_t const& event, int group_fd) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = event.type;
+		attr.config = event.config;
+		attr.disabled = group_fd == -1 ? 1 : 0;
+		attr.exclude_kernel = 1; // required for perf_event_paranoid >= 2
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+	}
+
+public:
+	perf_counter_group() {
+		for(std::size_t i = 0; i < max_events; ++i) {
+			int const fd = open_event(events()[i], m_leader);
+			if(fd == -1) {
+				if(m_leader == -1) {
+					return; // without cycles there is little point in measuring anything else
+				}
+				continue;
+			}
+			if(m_leader == -1) {
+				m_leader = fd;
+			}
+			m_fds[m_count] = fd;
+			m_names[m_count] = events()[i].name;
+			m_values[m_count] = 0;
+			++m_count;
+		}
+	}
+
+	perf_counter_group(perf_counter_group const&) = delete;
+	perf_counter_group& operator=(perf_counter_group const&) = delete;
+
+	~perf_counter_group() {
+		for(std::size_t i = 0; i < m_count; ++i) {
+			close(m_fds[i]);
+		}
+	}
+
+	bool available() const noexcept { return m_leader != -1; }
+	std::size_t size() const noexcept { return m_count; }
+	char const* name(std::size_t index) const noexcept { return m_names[index]; }
+	double value(std::size_t index) const noexcept { return m_values[index]; }
+
+	void start() {
+		if(m_leader != -1) {
+			ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+	}
+
+	// Returns false if the counters could not be read or were never scheduled onto the PMU during the interval.
+	bool stop() {
+		if(m_leader == -1) {
+			return false;
+		}
+		ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+		// layout for PERF_FORMAT_GROUP: nr, time_enabled, time_running, values[nr]
+		std::uint64_t buffer[3 + max_events];
+		ssize_t const expected = static_cast<ssize_t>((3 + m_count) * sizeof(std::uint64_t));
+		if(read(m_leader, buffer, sizeof(buffer)) < expected || buffer[0] != m_count || buffer[2] == 0) {
+			return false;
+		}
+		// the group may have been multiplexed with other users of the PMU, so extrapolate to the full interval
+		double const scale = static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]);
+		for(std::size_t i = 0; i < m_count; ++i) {
+			m_values[i] = static_cast<double>(buffer[3 + i]) * scale;
+		}
+		return true;
+	}
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+// linux-specific: resource usage of the current process from getrusage(2) and /proc
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+struct process_stats {
+	std::uint64_t rss_bytes; // current resident set
+	std::uint64_t minor_faults;
+	std::uint64_t major_faults;
+
+	static process_stats take() noexcept {
+		process_stats result = process_stats();
+		rusage usage;
+		if(getrusage(RUSAGE_SELF, &usage) == 0) {
+			result.minor_faults = static_cast<std::uint64_t>(usage.ru_minflt);
+			result.major_faults = static_cast<std::uint64_t>(usage.ru_majflt);
+		}
+		// the second field of statm is the number of resident pages
+		if(std::FILE* const file = std::fopen("/proc/self/statm", "r")) {
+			unsigned long long size_pages, resident_pages;
+			if(std::fscanf(file, "%llu %llu", &size_pages, &resident_pages) == 2) {
+				result.rss_bytes = static_cast<std::uint64_t>(resident_pages) * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+			}
+			std::fclose(file);
+		}
+		return result;
+	}
+};
+
+// Sums up the AnonHugePages entries of /proc/self/smaps_rollup (or, for kernels older than 4.14, /proc/self/smaps).
+// Returns false if neither can be read. Reading smaps walks the page tables of the whole process, which is slow for
+// large heaps, so this should only be sampled outside of timed regions.
+inline bool anon_huge_pages_bytes(std::uint64_t& bytes) noexcept {
+	std::FILE* file = std::fopen("/proc/self/smaps_rollup", "r");
+	if(!file) {
+		file = std::fopen("/proc/self/smaps", "r");
+		if(!file) {
+			return false;
+		}
+	}
+	bytes = 0;
+	char line[256];
+	while(std::fgets(line, sizeof(line), file)) {
+		unsigned long long kib;
+		if(std::strncmp(line, "AnonHugePages:", 14) == 0 && std::sscanf(line + 14, "%llu", &kib) == 1) {
+			bytes += static_cast<std::uint64_t>(kib) * 1024;
+		}
+	}
+	std::fclose(file);
+	return true;
+}
@@ -0,0 +1,215 @@
+#ifndef BUFFER_TRACE_H_
+#define BUFFER_TRACE_H_
+
+// Recording shim for new_buffer workloads: `recorded_buffer` behaves like a new_buffer, but logs every operation to a
+// binary trace that the `trace_replay` benchmark in main.cpp replays against each specialization. To record a program,
+// substitute recorded_buffer for new_buffer (e.g., in the alias that defines the vector type) and run it with
+// $BUFFER_TRACE_FILE pointing to the output file (default: buffer.trace).
+//
+// File format: the 8 byte magic "BUFTRACE", a little endian uint32 version and uint32 record size, followed by
+// fixed-size records in the order in which the operations were performed.
+
+#include "new_buffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+enum class buffer_trace_op : std::uint8_t {
+    construct = 0, // default construction
+    destroy = 1,
+    push_back = 2,
+    pop_back = 3,
+    resize = 4, // argument: new size
+    shrink = 5, // argument: new size, which is at most the old size
+    copy = 6, // copy construction, argument: id of the source
+    index = 7, // argument: index
+    assign = 8, // copy assignment, argument: id of the source
+};
+
+struct buffer_trace_record {
+    std::uint64_t argument;
+    std::uint32_t id; // buffers are numbered consecutively from 0 in order of construction
+    buffer_trace_op op;
+    std::uint8_t reserved[3];
+};
+static_assert(sizeof(buffer_trace_record) == 16, "the trace format relies on records without padding");
+
+static char const buffer_trace_magic[8] = { 'B', 'U', 'F', 'T', 'R', 'A', 'C', 'E' };
+static std::uint32_t const buffer_trace_version = 1;
+
+class buffer_trace {
+    std::mutex m_mutex;
+    std::FILE* m_file = nullptr;
+    std::uint32_t m_next_id = 0;
+    std::vector<buffer_trace_record> m_buffer;
+
+    static constexpr std::size_t buffer_capacity = 1 << 16;
+
+    buffer_trace() {
+        char const* const path = std::getenv("BUFFER_TRACE_FILE");
+        m_file = std::fopen(path ? path : "buffer.trace", "wb");
+        if(m_file) {
+            std::uint32_t const header[2] = { buffer_trace_version, static_cast<std::uint32_t>(sizeof(buffer_trace_record)) };
+            std::fwrite(buffer_trace_magic, sizeof(buffer_trace_magic), 1, m_file);
+            std::fwrite(header, sizeof(header), 1, m_file);
+        }
+        m_buffer.reserve(buffer_capacity);
+        std::atexit([]() { instance().close(); });
+    }
+
+    // expects m_mutex to be held
+    void flush() {
+        if(m_file && !m_buffer.empty()) {
+            std::fwrite(m_buffer.data(), sizeof(buffer_trace_record), m_buffer.size(), m_file);
+        }
+        m_buffer.clear();
+    }
+
+public:
+    // never destroyed, so that buffers with static storage duration can still be traced during shutdown
+    static buffer_trace& instance() {
+        static buffer_trace* const trace = new buffer_trace();
+        return *trace;
+    }
+
+    std::uint32_t construct() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::uint32_t const id = m_next_id++;
+        append_locked(buffer_trace_op::construct, id, 0);
+        return id;
+    }
+
+    std::uint32_t copy_construct(std::uint32_t source) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::uint32_t const id = m_next_id++;
+        append_locked(buffer_trace_op::copy, id, source);
+        return id;
+    }
+
+    void append(buffer_trace_op op, std::uint32_t id, std::uint64_t argument) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        append_locked(op, id, argument);
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        flush();
+        if(m_file) {
+            std::fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+
+private:
+    void append_locked(buffer_trace_op op, std::uint32_t id, std::uint64_t argument) {
+        buffer_trace_record record;
+        std::memset(&record, 0, sizeof(record));
+        record.argument = argument;
+        record.id = id;
+        record.op = op;
+        m_buffer.push_back(record);
+        if(m_buffer.size() >= buffer_capacity) {
+            flush();
+        }
+    }
+};
+
+inline bool read_buffer_trace(char const* path, std::vector<buffer_trace_record>& records) {
+    std::FILE* const file = std::fopen(path, "rb");
+    if(!file) {
+        return false;
+    }
+    char magic[sizeof(buffer_trace_magic)];
+    std::uint32_t header[2];
+    if(std::fread(magic, sizeof(magic), 1, file) != 1 || std::memcmp(magic, buffer_trace_magic, sizeof(magic)) != 0
+        || std::fread(header, sizeof(header), 1, file) != 1 || header[0] != buffer_trace_version || header[1] != sizeof(buffer_trace_record)) {
+        std::fclose(file);
+        return false;
+    }
+    buffer_trace_record record;
+    while(std::fread(&record, sizeof(record), 1, file) == 1) {
+        records.push_back(record);
+    }
+    std::fclose(file);
+    return true;
+}
+
+// Only the operations that the trace format knows about are exposed, so that recording a program fails to compile
+// rather than silently missing operations. Moves are recorded as copies.
+template<typename T, typename SZ, std::size_t INITIAL_SIZE>
+class recorded_buffer {
+public:
+    using buffer_type = new_buffer<T, SZ, INITIAL_SIZE>;
+    using value_type = typename buffer_type::value_type;
+    using size_type = typename buffer_type::size_type;
+    using reference = typename buffer_type::reference;
+    using const_reference = typename buffer_type::const_reference;
+
+private:
+    buffer_type m_buffer;
+    std::uint32_t m_id;
+
+public:
+    recorded_buffer() : m_id(buffer_trace::instance().construct()) { }
+
+    recorded_buffer(recorded_buffer const& other) : m_buffer(other.m_buffer), m_id(buffer_trace::instance().copy_construct(other.m_id)) { }
+
+    recorded_buffer& operator=(recorded_buffer const& other) {
+        if(this != &other) {
+            buffer_trace::instance().append(buffer_trace_op::assign, m_id, other.m_id);
+            m_buffer = other.m_buffer;
+        }
+        return *this;
+    }
+
+    ~recorded_buffer() {
+        buffer_trace::instance().append(buffer_trace_op::destroy, m_id, 0);
+    }
+
+    bool empty() const noexcept { return m_buffer.empty(); }
+    size_type size() const noexcept { return m_buffer.size(); }
+    size_type capacity() const noexcept { return m_buffer.capacity(); }
+
+    reference operator[](size_type index) {
+        buffer_trace::instance().append(buffer_trace_op::index, m_id, index);
+        return m_buffer[index];
+    }
+
+    const_reference operator[](size_type index) const {
+        buffer_trace::instance().append(buffer_trace_op::index, m_id, index);
+        return m_buffer[index];
+    }
+
+    void push_back(value_type const& value) {
+        buffer_trace::instance().append(buffer_trace_op::push_back, m_id, 0);
+        m_buffer.push_back(value);
+    }
+
+    void pop_back() {
+        buffer_trace::instance().append(buffer_trace_op::pop_back, m_id, 0);
+        m_buffer.pop_back();
+    }
+
+    void resize(size_type count) {
+        buffer_trace::instance().append(buffer_trace_op::resize, m_id, count);
+        m_buffer.resize(count);
+    }
+
+    void shrink(size_type count) {
+        SASSERT(count <= size());
+        buffer_trace::instance().append(buffer_trace_op::shrink, m_id, count);
+        m_buffer.resize(count);
+    }
+
+    void clear() { shrink(0); }
+    void reset() { shrink(0); }
+
+    value_type const* c_ptr() const { return m_buffer.c_ptr(); }
+};
+
+#endif /* BUFFER_TRACE_H_ */
@@ -23,44 +23,68 @@ def mean_interval(confidence, data):
 	assert(math.isclose(mean - low, high - mean))
 	return (mean, mean - low)
 
-def main(inputs):
+# The cold cache modes time their iterations manually, which is reported as real_time, while cpu_time also covers the
+# cache eviction between the iterations.
+def metric_value(run, metric):
+	if metric == "cpu_time" and run["name"].endswith("/manual_time"):
+		return run["real_time"]
+	return run[metric]
+
+def main(inputs, metrics):
 	data = {}
 	for input in inputs:
 		with open(input) as f:
 			raw_data = json.load(f)
 		for b in raw_data["benchmarks"]:
-			match = re.fullmatch("(?P<name>[a-zA-Z_]+)<(?P<template>[^>]+)>/(?P<size>\\d+)(?:_(?P<stat>mean|median|stddev))?", b["name"])
+			# named arguments such as /pattern:3 follow the size and select a series of their own
+			match = re.fullmatch("(?P<name>[a-zA-Z_]+)<(?P<template>[^>]+)>(?:/(?P<size>\\d+))?(?P<parts>(?:/(?!iterations:)[a-zA-Z_]+:\\d+)*)(?:/iterations:\\d+)?(?:/manual_time)?(?:_(?P<stat>mean|median|stddev))?", b["name"])
 			if not match:
 				print("Borked match on name", b["name"])
 				sys.exit(1)
 			if match.group("stat"):
 				continue # it would be much easier if it was possible to disable this....
+			if b.get("error_occurred"):
+				continue # e.g., trace_replay without a trace
+			size = int(match.group("size") or 1) # unparameterized benchmarks are plotted as a single point
+			parts = tuple((key, int(value)) for key, value in re.findall("/([a-zA-Z_]+):(\\d+)", match.group("parts")))
+			series = (match.group("template"), parts) # parts sort numerically, e.g., size:4 before size:16
 			if match.group("name") not in data:
 				data[match.group("name")] = {}
-			if match.group("template") not in data[match.group("name")]:
-				data[match.group("name")][match.group("template")] = {}
-			if int(match.group("size")) not in data[match.group("name")][match.group("template")]:
-				data[match.group("name")][match.group("template")][int(match.group("size"))] = []
-			data[match.group("name")][match.group("template")][int(match.group("size"))].append(b)
+			if series not in data[match.group("name")]:
+				data[match.group("name")][series] = {}
+			if size not in data[match.group("name")][series]:
+				data[match.group("name")][series][size] = []
+			data[match.group("name")][series][size].append(b)
 
 	with PdfPages('graphs.pdf') as pdf:
 		for name,group in sorted(data.items()):
-			plt.figure(figsize=[11.69, 8.27])
-			plt.title(f"{name} (99% confidence)")
-			plt.yscale('log')
-			plt.xscale('log')
-			plt.grid(True)
-			for template,series in sorted(group.items()):
-				ser = sorted(series.items())
-				values = [mean_interval(0.99, [y["real_time"] for y in x[1]]) for x in ser]
-				plt.errorbar([t[0] for t in ser], [t[0] for t in values], yerr=[t[1] for t in values], label=f"INITIAL_SIZE={template}")
+			for metric in metrics:
+				# counters are only present for some allocators and build options
+				if not any(metric in y for series in group.values() for x in series.values() for y in x):
+					continue
+				plt.figure(figsize=[11.69, 8.27])
+				plt.title(f"{name}: {metric} (99% confidence)")
+				plt.yscale('log')
+				plt.xscale('log')
+				plt.grid(True)
+				# one color per template and one line style per combination of named arguments, e.g., per buffer size
+				templates = sorted({template for template, _ in group})
+				combinations = sorted({parts for _, parts in group})
+				for (template,parts),series in sorted(group.items()):
+					ser = sorted((size, runs) for size, runs in series.items() if all(metric in y for y in runs))
+					values = [mean_interval(0.99, [metric_value(y, metric) for y in x[1]]) for x in ser]
+					label = ", ".join([f"INITIAL_SIZE={template}"] + [f"{key}:{value}" for key, value in parts])
+					style = combinations.index(parts)
+					plt.errorbar([t[0] for t in ser], [t[0] for t in values], yerr=[t[1] for t in values], label=label,
+						color=f"C{templates.index(template) % 10}", linestyle=["-", "--", ":", "-."][style % 4], marker=[None, "o", "^", "s", "x", "d"][style % 6])
 
-			plt.legend()
-			pdf.savefig()
-			plt.close()
+				plt.legend()
+				pdf.savefig()
+				plt.close()
 
 import argparse
 parser = argparse.ArgumentParser()
 parser.add_argument("inputs", nargs="+")
+parser.add_argument("--metrics", nargs="+", default=["real_time", "resident", "allocated", "fragmentation"], help="benchmark fields or counters to plot, one page per benchmark and metric")
 args = parser.parse_args()
-main(args.inputs)
+main(args.inputs, args.metrics)
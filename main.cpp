@@ -1,60 +1,200 @@
 #include "new_buffer.h"
+#include "new_buffer_io.h"
+#include "new_buffer_usage.h"
+#include "auto_buffer.h"
+#include "buffer_trace.h"
+#include "bench/access_pattern.h"
+#include "bench/alloc_tracker.h"
+#include "bench/cache_state.h"
+#include "bench/allocator_stats.h"
+#include "bench/perf_counters.h"
+#include "bench/process_stats.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <random>
+#include <type_traits>
+#include <vector>
 #include <benchmark/benchmark.h>
-#include <sys/resource.h>
+
+#include <unistd.h>
 
 #define SEED (1337)
 #define GRANULARITY (8)
 
-#if defined(JEMALLOC) && JEMALLOC
-#include <jemalloc/jemalloc.h>
+// Memory is never measured inside the timed loop (pausing the timers costs on the order of 2 us on my machines).
+// Instead, a probe is taken before the buffers of interest are built, either during setup or in an untimed replay of one
+// iteration, and `record` is called while they are still alive. Heap usage is taken from the allocation tracker if it is
+// present, and from the allocator's own statistics otherwise.
+#if !defined(MEASURE_MEMORY)
+#define MEASURE_MEMORY 1
 #endif
 
-#if defined(TCMALLOC) && TCMALLOC
-#include <gperftools/malloc_extension.h>
+// The specializations that auto_buffer picks for the element types of the suite, benchmarked next to the hand-picked
+// ones. The layouts they resolve to are listed in the benchmark context.
+using auto_simple_selector = auto_buffer_selector<unsigned, unsigned, 8, 64>;
+using auto_complex_selector = auto_buffer_selector<std::string, unsigned, 8, 64>;
+static constexpr std::size_t auto_simple = auto_simple_selector::initial_size;
+static constexpr std::size_t auto_complex = auto_complex_selector::initial_size;
+static bool const auto_buffer_context = (
+	benchmark::AddCustomContext("auto_simple", "auto_buffer<unsigned, 8, 64> = " + auto_simple_selector::describe()),
+	benchmark::AddCustomContext("auto_complex", "auto_buffer<std::string, 8, 64> = " + auto_complex_selector::describe()),
+	true);
+
+// the benchmarks that support it are also labelled with the mode
+static bool const cache_mode_context = (
+	benchmark::AddCustomContext("cache_mode", cache_mode_name(cache_state::mode())),
+	true);
+
+#if defined(MEMORY_ACCOUNTING) && MEMORY_ACCOUNTING
+// compare against a build without accounting to obtain its overhead
+static bool const memory_accounting_context = (
+	benchmark::AddCustomContext("memory_accounting", "batched per-thread counters, " + std::to_string(memory_accounting::batch_bytes) + " bytes per flush"),
+	true);
 #endif
 
-#if defined(JEMALLOC) && JEMALLOC
-static std::size_t malloced_bytes() {
-	std::uint64_t epoch;
-	std::size_t size = sizeof(epoch);
-	mallctl("epoch", &epoch, &size, &epoch, size);
+// the shrink policy evaluated next to the default of never shrinking
+using hysteresis = new_buffer_hysteresis_shrink<16>;
+
+class memory_probe {
+	benchmark::State& m_state;
+	allocator_stats m_allocator = allocator_stats();
+	alloc_tracker_stats m_allocations = alloc_tracker_stats();
 
-	std::size_t count = 0;
-	size = sizeof(count);
-	if(mallctl("stats.allocated", &count, &size, nullptr, 0)) {
-		return 0;
+public:
+	static constexpr bool enabled = MEASURE_MEMORY;
+
+	explicit memory_probe(benchmark::State& state) : m_state(state) {
+		if(enabled) {
+			m_allocator = allocator_stats::take();
+			m_allocations = alloc_tracker::snapshot();
+			alloc_tracker::reset_peak();
+		}
 	}
-	return count;
-}
-#elif defined(TCMALLOC) && TCMALLOC
-static std::size_t malloced_bytes() {
-	std::size_t count = 0;
-	MallocExtension::instance()->GetNumericProperty("generic.current_allocated_bytes", &count);
-	return count;
-}
-#else
-static std::size_t malloced_bytes() {
-		return 0;
-}
+
+	memory_probe(memory_probe const&) = delete;
+	memory_probe& operator=(memory_probe const&) = delete;
+
+	// `object_bytes` is the size of the buffer objects themselves, `elements` is the number of elements they hold in total
+	void record(std::size_t object_bytes, std::size_t elements, std::size_t element_size) {
+		if(!enabled) {
+			return;
+		}
+
+		allocator_stats const allocator = allocator_stats::take();
+		if(allocator_stats_available) {
+			m_state.counters["allocated"] = benchmark::Counter(allocator.allocated, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			m_state.counters["active"] = benchmark::Counter(allocator.active, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			m_state.counters["resident"] = benchmark::Counter(allocator.resident, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			m_state.counters["mapped"] = benchmark::Counter(allocator.mapped, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			m_state.counters["metadata"] = benchmark::Counter(allocator.metadata, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			m_state.counters["retained"] = benchmark::Counter(allocator.retained, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			m_state.counters["thread_cache"] = benchmark::Counter(allocator.thread_cache, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+			if(!std::isnan(allocator.fragmentation())) {
+				m_state.counters["fragmentation"] = allocator.fragmentation();
+			}
+		}
+
+		double heap_bytes = 0;
+		if(alloc_tracker::available()) {
+			alloc_tracker_stats const allocations = alloc_tracker::snapshot();
+			heap_bytes = static_cast<double>(allocations.live_bytes - m_allocations.live_bytes);
+			m_state.counters["peak_heap_bytes"] = static_cast<double>(allocations.peak_bytes - m_allocations.live_bytes);
+		} else if(allocator_stats_available) {
+			heap_bytes = static_cast<double>(allocator.allocated) - static_cast<double>(m_allocator.allocated);
+		} else {
+			return;
+		}
+		double const footprint = static_cast<double>(object_bytes) + heap_bytes;
+		m_state.counters["heap_bytes"] = heap_bytes;
+		if(elements > 0) {
+			m_state.counters["bytes_per_element"] = footprint / static_cast<double>(elements);
+			// footprint per byte of payload, 1 for a buffer without any overhead
+			m_state.counters["footprint_ratio"] = footprint / static_cast<double>(elements * element_size);
+		}
+	}
+};
+
+// Wraps the timed loop of a benchmark; counters are sampled once before and once after the loop, so that individual
+// iterations are not perturbed.
+class measurement_scope {
+	benchmark::State& m_state;
+	alloc_tracker_stats m_allocations;
+	process_stats m_setup; // before m_process, so that the first previous_end() is taken before it
+	process_stats m_process;
+
+	// Taken at the end of every timed loop. Everything up to the next timed loop is attributed to the setup of the next
+	// benchmark, which includes the teardown of the previous one, but freeing memory does not fault.
+	static process_stats& previous_end() {
+		static process_stats result = process_stats::take();
+		return result;
+	}
+#if defined(MEASURE_PERF) && MEASURE_PERF
+	perf_counter_group m_perf;
 #endif
 
-// note: recording memory usage costs on the order of 2 us on my machines
-#if defined(MEASURE_MEMORY) && MEASURE_MEMORY
-inline static void record_memory_usage(benchmark::State& state) {
-	state.PauseTiming();
-	state.counters["malloc"] = malloced_bytes();
-	state.ResumeTiming();
-}
-#else
-inline static void record_memory_usage(benchmark::State& _) {}
+public:
+	explicit measurement_scope(benchmark::State& state) : m_state(state), m_allocations(alloc_tracker::snapshot()), m_setup(previous_end()), m_process(process_stats::take()) {
+		alloc_tracker::reset_peak();
+#if defined(MEASURE_PERF) && MEASURE_PERF
+		m_perf.start();
+#endif
+	}
+
+	measurement_scope(measurement_scope const&) = delete;
+	measurement_scope& operator=(measurement_scope const&) = delete;
+
+	~measurement_scope() {
+		process_stats const process = process_stats::take();
+		m_state.counters["minor_faults"] = benchmark::Counter(process.minor_faults - m_process.minor_faults, benchmark::Counter::kAvgIterations);
+		m_state.counters["major_faults"] = benchmark::Counter(process.major_faults - m_process.major_faults, benchmark::Counter::kAvgIterations);
+		// faulting in the buffers that are built before the timed loop, e.g., the 4 GiB of the largest random access benchmarks
+		m_state.counters["setup_minor_faults"] = static_cast<double>(m_process.minor_faults - m_setup.minor_faults);
+		m_state.counters["setup_major_faults"] = static_cast<double>(m_process.major_faults - m_setup.major_faults);
+		m_state.counters["rss"] = benchmark::Counter(process.rss_bytes, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+		previous_end() = process;
+#if defined(MEASURE_HUGEPAGES) && MEASURE_HUGEPAGES
+		std::uint64_t huge_pages_bytes;
+		if(anon_huge_pages_bytes(huge_pages_bytes)) {
+			m_state.counters["anon_huge_pages"] = benchmark::Counter(huge_pages_bytes, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+		}
 #endif
 
+		// only available if the allocation tracker is linked in or preloaded, but then with the same names for every allocator
+		if(alloc_tracker::available()) {
+			alloc_tracker_stats const allocations = alloc_tracker::snapshot();
+			m_state.counters["mallocs"] = benchmark::Counter(allocations.mallocs - m_allocations.mallocs, benchmark::Counter::kAvgIterations);
+			m_state.counters["reallocs"] = benchmark::Counter(allocations.reallocs - m_allocations.reallocs, benchmark::Counter::kAvgIterations);
+			m_state.counters["realloc_moves"] = benchmark::Counter(allocations.realloc_moves - m_allocations.realloc_moves, benchmark::Counter::kAvgIterations);
+			m_state.counters["frees"] = benchmark::Counter(allocations.frees - m_allocations.frees, benchmark::Counter::kAvgIterations);
+			m_state.counters["peak_bytes"] = allocations.peak_bytes - m_allocations.live_bytes;
+		}
+#if defined(MEASURE_PERF) && MEASURE_PERF
+		// when perf is restricted (e.g. perf_event_paranoid or containers), the counters are simply omitted
+		if(m_perf.stop()) {
+			double cycles = 0;
+			double instructions = 0;
+			for(std::size_t i = 0; i < m_perf.size(); ++i) {
+				m_state.counters[m_perf.name(i)] = benchmark::Counter(m_perf.value(i), benchmark::Counter::kAvgIterations);
+				if(std::strcmp(m_perf.name(i), "cycles") == 0) { cycles = m_perf.value(i); }
+				if(std::strcmp(m_perf.name(i), "instructions") == 0) { instructions = m_perf.value(i); }
+			}
+			if(cycles > 0 && instructions > 0) {
+				m_state.counters["IPC"] = instructions / cycles;
+			}
+		}
+#endif
+	}
+};
+
 template<std::size_t initial_size>
 static void simple_copy(benchmark::State& state) {
 	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
@@ -69,18 +209,27 @@ static void simple_copy(benchmark::State& state) {
 	for(auto& u : source) {
 		u = unsigned_distribution(prng);
 	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination(source);
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	cache_state cache(state);
+	cache.add_buffer(source);
+	measurement_scope measurement(state);
 	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
 		vec_t destination(source);
 		benchmark::DoNotOptimize(destination.c_ptr());
 		benchmark::ClobberMemory();
-		record_memory_usage(state);
 	}
 }
-BENCHMARK_TEMPLATE(simple_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
 
 template<std::size_t initial_size>
 static void simple_pushback_copy(benchmark::State& state) {
@@ -96,21 +245,235 @@ static void simple_pushback_copy(benchmark::State& state) {
 	for(auto& u : source) {
 		u = unsigned_distribution(prng);
 	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination;
+		for(auto const u : source) {
+			destination.push_back(u);
+		}
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	cache_state cache(state);
+	cache.add_buffer(source);
+	measurement_scope measurement(state);
 	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
 		vec_t destination;
 		for(auto const u : source) {
 			destination.push_back(u);
 		}
 		benchmark::DoNotOptimize(destination.c_ptr());
 		benchmark::ClobberMemory();
-		record_memory_usage(state);
 	}
 }
-BENCHMARK_TEMPLATE(simple_pushback_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_pushback_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_pushback_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_pushback_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(simple_pushback_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_pushback_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_pushback_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_pushback_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_pushback_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_pushback_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_pushback_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+
+// like simple_pushback_copy, but with the capacity reserved up front, so that only the capacity checks remain
+template<std::size_t initial_size>
+static void simple_reserved_pushback_copy(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination;
+		destination.ensure_capacity(source.size());
+		for(auto const u : source) {
+			destination.push_back(u);
+		}
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination;
+		destination.ensure_capacity(source.size());
+		for(auto const u : source) {
+			destination.push_back(u);
+		}
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(simple_reserved_pushback_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_reserved_pushback_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_reserved_pushback_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_reserved_pushback_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_reserved_pushback_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_reserved_pushback_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// like simple_reserved_pushback_copy, but without the capacity checks
+template<std::size_t initial_size>
+static void simple_unchecked_pushback_copy(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination;
+		destination.ensure_capacity(source.size());
+		for(auto const u : source) {
+			destination.push_back_unchecked(u);
+		}
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination;
+		destination.ensure_capacity(source.size());
+		for(auto const u : source) {
+			destination.push_back_unchecked(u);
+		}
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(simple_unchecked_pushback_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_unchecked_pushback_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_unchecked_pushback_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_unchecked_pushback_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_unchecked_pushback_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_unchecked_pushback_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// Wraps a pointer, but only admits single-pass iteration, so that ranges of it cannot be measured up front.
+template<typename T>
+class input_only_iterator {
+	T const* m_position;
+
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = T;
+	using difference_type = std::ptrdiff_t;
+	using pointer = T const*;
+	using reference = T const&;
+
+	explicit input_only_iterator(T const* position) : m_position(position) { }
+	reference operator*() const { return *m_position; }
+	input_only_iterator& operator++() { ++m_position; return *this; }
+	bool operator==(input_only_iterator const& other) const { return m_position == other.m_position; }
+	bool operator!=(input_only_iterator const& other) const { return m_position != other.m_position; }
+};
+
+// constructs a buffer from the iterators of a std::vector, which are measured and copied at once
+template<std::size_t initial_size>
+static void range_from_vector(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	std::vector<unsigned> source(state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination(source.begin(), source.end());
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination(source.begin(), source.end());
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(range_from_vector, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_vector, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_vector, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_vector, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_vector, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_vector, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// constructs a buffer from another specialization, whose pointers are bulk copied
+template<std::size_t initial_size>
+static void range_from_buffer(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	new_buffer<unsigned, unsigned, 0> source(state.range(0), 0u);
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination(source.begin(), source.end());
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination(source.begin(), source.end());
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(range_from_buffer, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_buffer, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_buffer, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_buffer, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_buffer, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_buffer, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// constructs a buffer from input iterators, which grow it like push_back
+template<std::size_t initial_size>
+static void range_from_input(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	std::vector<unsigned> source(state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination(input_only_iterator<unsigned>(source.data()), input_only_iterator<unsigned>(source.data() + source.size()));
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination(input_only_iterator<unsigned>(source.data()), input_only_iterator<unsigned>(source.data() + source.size()));
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(range_from_input, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_input, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_input, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_input, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_input, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(range_from_input, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
 
 template<std::size_t initial_size>
 static void simple_interleaved_pushback_copy(benchmark::State& state) {
@@ -133,6 +496,21 @@ static void simple_interleaved_pushback_copy(benchmark::State& state) {
 	for(auto& u : source2) { u = unsigned_distribution(prng); }
 	for(auto& u : source3) { u = unsigned_distribution(prng); }
 	for(auto& u : source4) { u = unsigned_distribution(prng); }
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination1;
+		vec_t destination2;
+		vec_t destination3;
+		vec_t destination4;
+		for(typename vec_t::size_type i = 0, end = static_cast<typename vec_t::size_type>(state.range(0)); i < end; ++i) {
+			destination1.push_back(source1[i]);
+			destination2.push_back(source2[i]);
+			destination3.push_back(source3[i]);
+			destination4.push_back(source4[i]);
+		}
+		probe.record(4 * sizeof(vec_t), 4 * static_cast<std::size_t>(state.range(0)), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
 	for(auto _ : state) {
 		vec_t destination1;
 		vec_t destination2;
@@ -149,7 +527,6 @@ static void simple_interleaved_pushback_copy(benchmark::State& state) {
 		benchmark::DoNotOptimize(destination3.c_ptr());
 		benchmark::DoNotOptimize(destination4.c_ptr());
 		benchmark::ClobberMemory();
-		record_memory_usage(state);
 	}
 }
 BENCHMARK_TEMPLATE(simple_interleaved_pushback_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
@@ -157,6 +534,7 @@ BENCHMARK_TEMPLATE(simple_interleaved_pushback_copy, -1)->RangeMultiplier(GRANUL
 BENCHMARK_TEMPLATE(simple_interleaved_pushback_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
 BENCHMARK_TEMPLATE(simple_interleaved_pushback_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
 BENCHMARK_TEMPLATE(simple_interleaved_pushback_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(simple_interleaved_pushback_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
 
 template<std::size_t initial_size>
 static void complex_copy(benchmark::State& state) {
@@ -172,18 +550,27 @@ static void complex_copy(benchmark::State& state) {
 	for(auto& u : source) {
 		u = unsigned_distribution(prng);
 	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination(source);
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	cache_state cache(state);
+	cache.add_buffer(source);
+	measurement_scope measurement(state);
 	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
 		vec_t destination(source);
 		benchmark::DoNotOptimize(destination.c_ptr());
 		benchmark::ClobberMemory();
-		record_memory_usage(state);
 	}
 }
-BENCHMARK_TEMPLATE(complex_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(complex_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(complex_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(complex_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
-BENCHMARK_TEMPLATE(complex_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(complex_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy, auto_complex)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
 
 template<std::size_t initial_size>
 static void complex_pushback_copy(benchmark::State& state) {
@@ -196,6 +583,15 @@ static void complex_pushback_copy(benchmark::State& state) {
 
 	vec_t source(state.range(0), std::string());
 	assert(source.size() == state.range(0));
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t destination;
+		for(auto const u : source) {
+			destination.push_back(u);
+		}
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
 	for(auto _ : state) {
 		vec_t destination;
 		for(auto const u : source) {
@@ -203,7 +599,6 @@ static void complex_pushback_copy(benchmark::State& state) {
 		}
 		benchmark::DoNotOptimize(destination.c_ptr());
 		benchmark::ClobberMemory();
-		record_memory_usage(state);
 	}
 }
 BENCHMARK_TEMPLATE(complex_pushback_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
@@ -211,6 +606,67 @@ BENCHMARK_TEMPLATE(complex_pushback_copy, -1)->RangeMultiplier(GRANULARITY)->Ran
 BENCHMARK_TEMPLATE(complex_pushback_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
 BENCHMARK_TEMPLATE(complex_pushback_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
 BENCHMARK_TEMPLATE(complex_pushback_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(complex_pushback_copy, auto_complex)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// Assigns to the same destination in every iteration. The strings are too long for the small string optimization, so
+// that an assignment which reuses the destination's elements does not allocate.
+template<std::size_t initial_size>
+static void complex_copy_assign(benchmark::State& state) {
+	using vec_t = new_buffer<std::string, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> length_distribution(24, 64);
+	std::uniform_int_distribution<int> char_distribution('a', 'z'); // char is not a valid IntType
+
+	vec_t source(state.range(0), std::string());
+	assert(source.size() == state.range(0));
+	for(auto& u : source) {
+		u.resize(length_distribution(prng));
+		for(auto& c : u) {
+			c = static_cast<char>(char_distribution(prng));
+		}
+	}
+	vec_t destination(source);
+	cache_state cache(state);
+	for(vec_t const* buffer : { &source, &destination }) {
+		cache.add_buffer(*buffer);
+		for(auto const& u : *buffer) {
+			cache.add(u.data(), u.size());
+		}
+	}
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		destination = source;
+		probe.record(sizeof(destination), destination.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
+		destination = source;
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(complex_copy_assign, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy_assign, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy_assign, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy_assign, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy_assign, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(complex_copy_assign, auto_complex)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+
+// every size of the random access benchmarks, once per access pattern
+static void random_access_arguments(benchmark::internal::Benchmark* family) {
+	std::vector<std::int64_t> patterns;
+	for(int pattern = 0; pattern < access_pattern_count; ++pattern) {
+		patterns.push_back(pattern);
+	}
+	family->ArgsProduct({ benchmark::CreateRange(1, 1<<30, GRANULARITY), patterns })->ArgNames({ "", "pattern" });
+	cache_state::timing(family);
+}
+
+static constexpr std::size_t random_accesses = 100000; // per iteration
 
 template<std::size_t initial_size>
 static void simple_random_assignments(benchmark::State& state) {
@@ -219,35 +675,36 @@ static void simple_random_assignments(benchmark::State& state) {
 	for(int i = 0; i <= 10000; ++i) {
 		prng();
 	}
-	std::uniform_int_distribution<unsigned> unsigned_distribution;
-	std::uniform_int_distribution<unsigned> size_distribution(0, state.range(0) - 1);
+	access_pattern const pattern = static_cast<access_pattern>(state.range(1));
+	access_stream stream(pattern, state.range(0), random_accesses, prng);
+	cache_state cache(state, access_pattern_name(pattern));
 
+	memory_probe probe(state);
 	vec_t vec(state.range(0), 0u);
 	assert(vec.size() == state.range(0));
+	probe.record(sizeof(vec), vec.size(), sizeof(typename vec_t::value_type));
+	cache.add_buffer(vec);
+	measurement_scope measurement(state);
 	for(auto _ : state) {
-		for(int i = 0; i < 10000; ++i) {
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
-			vec[size_distribution(prng)] = size_distribution(prng);
+		cache_state::iteration const iteration(cache);
+		std::uint32_t const* const indices = stream.next();
+		for(std::size_t i = 0; i < random_accesses; ++i) {
+			vec[indices[i]] = static_cast<unsigned>(i);
 		}
 		benchmark::DoNotOptimize(vec.c_ptr());
 		benchmark::ClobberMemory();
-		record_memory_usage(state);
 	}
+	state.SetItemsProcessed(state.iterations() * random_accesses);
 }
-BENCHMARK_TEMPLATE(simple_random_assignments, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_assignments, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_assignments, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_assignments, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_assignments, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
+BENCHMARK_TEMPLATE(simple_random_assignments, 0)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_assignments, -1)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_assignments, -2)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_assignments, 16)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_assignments, 1024)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_assignments, auto_simple)->Apply(random_access_arguments);
 
+// For pointer_chase, the buffer holds the cycle and every read depends on the one before it, so that the latency of the
+// accesses is measured instead of their throughput.
 template<std::size_t initial_size>
 static void simple_random_reads(benchmark::State& state) {
 	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
@@ -255,33 +712,765 @@ static void simple_random_reads(benchmark::State& state) {
 	for(int i = 0; i <= 10000; ++i) {
 		prng();
 	}
-	std::uniform_int_distribution<unsigned> unsigned_distribution;
-	std::uniform_int_distribution<unsigned> size_distribution(0, state.range(0) - 1);
+	access_pattern const pattern = static_cast<access_pattern>(state.range(1));
+	access_stream stream(pattern, state.range(0), random_accesses, prng);
+	cache_state cache(state, access_pattern_name(pattern));
 
+	memory_probe probe(state);
 	vec_t vec(state.range(0), 0u);
 	assert(vec.size() == state.range(0));
-	for(auto _ : state) {
-		for(int i = 0; i < 10000; ++i) {
+	probe.record(sizeof(vec), vec.size(), sizeof(typename vec_t::value_type));
+	cache.add_buffer(vec);
+	if(pattern == access_pattern::pointer_chase) {
+		std::uint32_t const* const cycle = stream.indices();
+		for(std::size_t i = 0; i < stream.period(); ++i) {
+			vec[cycle[i]] = cycle[(i + 1) % stream.period()];
+		}
+	}
+	measurement_scope measurement(state);
+	if(pattern == access_pattern::pointer_chase) {
+		unsigned position = stream.indices()[0];
+		for(auto _ : state) {
+			cache_state::iteration const iteration(cache);
+			for(std::size_t i = 0; i < random_accesses; ++i) {
+				position = vec[position];
+			}
+			benchmark::DoNotOptimize(position);
+		}
+	} else {
+		for(auto _ : state) {
+			cache_state::iteration const iteration(cache);
+			std::uint32_t const* const indices = stream.next();
 			unsigned x = 0;
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
-			x ^= vec[size_distribution(prng)];
+			for(std::size_t i = 0; i < random_accesses; ++i) {
+				x ^= vec[indices[i]];
+			}
 			benchmark::DoNotOptimize(x);
 		}
-		record_memory_usage(state);
 	}
+	state.SetItemsProcessed(state.iterations() * random_accesses);
+}
+BENCHMARK_TEMPLATE(simple_random_reads, 0)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_reads, -1)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_reads, -2)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_reads, 16)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_reads, 1024)->Apply(random_access_arguments);
+BENCHMARK_TEMPLATE(simple_random_reads, auto_simple)->Apply(random_access_arguments);
+
+// sums up a single buffer
+template<std::size_t initial_size>
+static void simple_scan(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	memory_probe probe(state);
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	probe.record(sizeof(source), source.size(), sizeof(typename vec_t::value_type));
+	cache_state cache(state);
+	cache.add_buffer(source);
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
+		unsigned sum = 0;
+		for(auto const u : source) {
+			sum += u;
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * source.size());
+}
+BENCHMARK_TEMPLATE(simple_scan, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_scan, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_scan, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_scan, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_scan, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(simple_scan, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+
+// every number of buffers of many_buffer_scan, once per buffer size
+static void many_buffer_arguments(benchmark::internal::Benchmark* family) {
+	family->ArgsProduct({ benchmark::CreateRange(1, 1<<20, GRANULARITY), { 0, 1, 4, 16, 64 } })->ArgNames({ "", "size" });
+	cache_state::timing(family);
+}
+
+// Sums up an array of small buffers, which were allocated one after another. Every buffer costs a load of its size
+// before its elements can be read, which for the 0 layout depends on the load of its data pointer.
+template<std::size_t initial_size>
+static void many_buffer_scan(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+	std::size_t const count = state.range(0);
+	std::size_t const size = state.range(1);
+
+	memory_probe probe(state);
+	std::vector<vec_t> buffers;
+	buffers.reserve(count);
+	for(std::size_t i = 0; i < count; ++i) {
+		buffers.emplace_back(size, 0u);
+		for(auto& u : buffers.back()) {
+			u = unsigned_distribution(prng);
+		}
+	}
+	probe.record(count * sizeof(vec_t), count * size, sizeof(typename vec_t::value_type));
+	cache_state cache(state);
+	for(auto const& buffer : buffers) {
+		cache.add_buffer(buffer);
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
+		unsigned sum = 0;
+		for(auto const& buffer : buffers) {
+			for(auto const u : buffer) {
+				sum += u;
+			}
+		}
+		benchmark::DoNotOptimize(sum);
+	}
+	state.SetItemsProcessed(state.iterations() * count * size);
+	state.counters["buffers_per_second"] = benchmark::Counter(static_cast<double>(state.iterations() * count), benchmark::Counter::kIsRate);
+}
+// without 1024, whose objects would take 4 GiB at 1<<20 buffers
+BENCHMARK_TEMPLATE(many_buffer_scan, 0)->Apply(many_buffer_arguments);
+BENCHMARK_TEMPLATE(many_buffer_scan, -1)->Apply(many_buffer_arguments);
+BENCHMARK_TEMPLATE(many_buffer_scan, -2)->Apply(many_buffer_arguments);
+BENCHMARK_TEMPLATE(many_buffer_scan, 16)->Apply(many_buffer_arguments);
+BENCHMARK_TEMPLATE(many_buffer_scan, auto_simple)->Apply(many_buffer_arguments);
+
+// hashes the middle half of a buffer through a span
+template<std::size_t initial_size>
+static void subrange_hash(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	buffer_span<unsigned const, unsigned> const subrange = buffer_span<unsigned const, unsigned>(source).subspan(source.size() / 4, source.size() / 2);
+	cache_state cache(state);
+	cache.add_buffer(source);
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
+		benchmark::DoNotOptimize(std::hash<buffer_span<unsigned const, unsigned>>()(subrange));
+	}
+	state.SetItemsProcessed(state.iterations() * subrange.size());
+}
+BENCHMARK_TEMPLATE(subrange_hash, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_hash, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_hash, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_hash, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_hash, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_hash, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+
+// like subrange_hash, but copies the subrange into a temporary buffer first
+template<std::size_t initial_size>
+static void subrange_hash_copy(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	for(auto& u : source) {
+		u = unsigned_distribution(prng);
+	}
+	unsigned const offset = source.size() / 4;
+	unsigned const count = source.size() / 2;
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t subrange;
+		subrange.append(count, source.c_ptr() + offset);
+		benchmark::DoNotOptimize(std::hash<vec_t>()(subrange));
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK_TEMPLATE(subrange_hash_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_hash_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_hash_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_hash_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_hash_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_hash_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// compares the two (equal) halves of a buffer through spans
+template<std::size_t initial_size>
+static void subrange_compare(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	unsigned const half = source.size() / 2;
+	for(unsigned i = 0; i < half; ++i) {
+		source[i] = source[half + i] = unsigned_distribution(prng);
+	}
+	buffer_span<unsigned const, unsigned> const whole(source);
+	cache_state cache(state);
+	cache.add_buffer(source);
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		cache_state::iteration const iteration(cache);
+		benchmark::DoNotOptimize(whole.first(half) == whole.subspan(half, half));
+	}
+	state.SetItemsProcessed(state.iterations() * half);
+}
+BENCHMARK_TEMPLATE(subrange_compare, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_compare, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_compare, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_compare, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_compare, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+BENCHMARK_TEMPLATE(subrange_compare, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20)->Apply(cache_state::timing);
+
+// like subrange_compare, but copies both halves into temporary buffers first
+template<std::size_t initial_size>
+static void subrange_compare_copy(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::uniform_int_distribution<unsigned> unsigned_distribution;
+
+	vec_t source(state.range(0), 0u);
+	assert(source.size() == state.range(0));
+	unsigned const half = source.size() / 2;
+	for(unsigned i = 0; i < half; ++i) {
+		source[i] = source[half + i] = unsigned_distribution(prng);
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t lhs;
+		lhs.append(half, source.c_ptr());
+		vec_t rhs;
+		rhs.append(half, source.c_ptr() + half);
+		benchmark::DoNotOptimize(lhs == rhs);
+	}
+	state.SetItemsProcessed(state.iterations() * half);
+}
+BENCHMARK_TEMPLATE(subrange_compare_copy, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_compare_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_compare_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_compare_copy, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_compare_copy, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(subrange_compare_copy, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// Keeps a population of buffers alive and applies millions of random operations to them, so that the allocator ends up
+// in the kind of fragmented state that long solver runs produce. The allocator is sampled after every batch.
+template<std::size_t initial_size, typename shrink_policy = new_buffer_no_shrink>
+static void fragmentation_churn(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size, shrink_policy>;
+	std::size_t const operations_per_batch = 1 << 15;
+	unsigned const max_size = 1 << 16;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	// most buffers stay tiny, a few become large (median 7, 99th percentile around 250 elements)
+	std::lognormal_distribution<double> size_distribution(2.0, 1.5);
+	std::uniform_int_distribution<std::size_t> slot_distribution(0, state.range(0) - 1);
+	std::uniform_int_distribution<unsigned> operation_distribution(0, 99);
+
+	std::vector<vec_t> population(state.range(0));
+	double resident_sum = 0;
+	double resident_peak = 0;
+	std::size_t samples = 0;
+
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		for(std::size_t i = 0; i < operations_per_batch; ++i) {
+			vec_t& buffer = population[slot_distribution(prng)];
+			unsigned const operation = operation_distribution(prng);
+			unsigned const size = buffer.size();
+			if(operation < 45) { // grow
+				unsigned const count = 1 + static_cast<unsigned>(size_distribution(prng)) / 4;
+				if(size + count > max_size) {
+					buffer.~vec_t();
+					::new(&buffer) vec_t();
+				} else {
+					for(unsigned j = 0; j < count; ++j) {
+						buffer.push_back(j);
+					}
+				}
+			} else if(operation < 60) { // shrink
+				buffer.resize(size / 2);
+			} else if(operation < 70) { // pop
+				for(unsigned j = std::min(size, 1 + static_cast<unsigned>(size_distribution(prng)) / 8); j > 0; --j) {
+					buffer.pop_back();
+				}
+			} else if(operation < 75) {
+				buffer.shrink_to_fit();
+			} else if(operation < 85) {
+				buffer.clear();
+			} else { // destroy and start over
+				buffer.~vec_t();
+				::new(&buffer) vec_t();
+			}
+		}
+
+		state.PauseTiming(); // negligible compared to a whole batch
+		double resident;
+		if(allocator_stats_available) {
+			resident = static_cast<double>(allocator_stats::take().resident);
+		} else {
+			resident = static_cast<double>(process_stats::take().rss_bytes); // the whole process, but it shrinks with the heap
+		}
+		resident_sum += resident;
+		resident_peak = std::max(resident_peak, resident);
+		++samples;
+		state.ResumeTiming();
+	}
+
+	std::size_t elements = 0;
+	for(auto const& buffer : population) {
+		elements += buffer.size();
+	}
+	allocator_stats const allocator = allocator_stats::take();
+	if(allocator_stats_available) {
+		state.counters["allocated"] = benchmark::Counter(allocator.allocated, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+		state.counters["resident"] = benchmark::Counter(allocator.resident, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+		if(!std::isnan(allocator.fragmentation())) {
+			state.counters["fragmentation"] = allocator.fragmentation();
+		}
+	}
+	state.counters["resident_peak"] = benchmark::Counter(resident_peak, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+	state.counters["resident_mean"] = benchmark::Counter(samples ? resident_sum / samples : 0, benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+	state.counters["payload"] = benchmark::Counter(elements * sizeof(typename vec_t::value_type), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+	state.SetItemsProcessed(state.iterations() * operations_per_batch);
+}
+BENCHMARK_TEMPLATE(fragmentation_churn, 0)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, -1)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, -2)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, 16)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, auto_simple)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, 0, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, -1, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, -2, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fragmentation_churn, 16, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16)->Iterations(128)->Unit(benchmark::kMillisecond);
+
+// Grows a buffer to its full size and drains it to a sixteenth with pop_back. Memory is recorded in the drained state,
+// which is where a shrink policy releases memory. 64 and 256 elements drain to 4 and 16, which fit into the inline
+// buffer of the 16 layout, so those runs include moving back out of the heap.
+template<std::size_t initial_size, typename shrink_policy = new_buffer_no_shrink>
+static void spike_drain(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size, shrink_policy>;
+	unsigned const count = state.range(0);
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		vec_t buffer;
+		for(unsigned i = 0; i < count; ++i) {
+			buffer.push_back(i);
+		}
+		while(buffer.size() > count / 16) {
+			buffer.pop_back();
+		}
+		probe.record(sizeof(buffer), buffer.size(), sizeof(typename vec_t::value_type));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t buffer;
+		for(unsigned i = 0; i < count; ++i) {
+			buffer.push_back(i);
+		}
+		while(buffer.size() > count / 16) {
+			buffer.pop_back();
+		}
+		benchmark::DoNotOptimize(buffer.c_ptr());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK_TEMPLATE(spike_drain, 0)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, 0, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, -1)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, -1, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, -2)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, -2, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, 16)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+BENCHMARK_TEMPLATE(spike_drain, 16, hysteresis)->RangeMultiplier(GRANULARITY)->Range(1<<4, 1<<20)->Arg(1<<8);
+
+template<typename vec_t>
+static vec_t keep(vec_t& clause, std::false_type) {
+	return std::move(clause);
+}
+
+template<typename vec_t>
+static auto keep(vec_t& clause, std::true_type) -> decltype(clause.freeze()) {
+	return clause.freeze();
+}
+
+// Builds a population of clause-like buffers with push_back and keeps them, either as they are or frozen to their exact
+// size. Memory is recorded with the whole population alive, so heap_bytes shows the growth slack that freezing drops.
+template<std::size_t initial_size, bool freeze>
+static void clause_population(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	using kept_t = typename std::conditional<freeze, frozen_buffer<unsigned, unsigned>, vec_t>::type;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	// learned clauses: mostly short, with a long tail (median 7, 99th percentile around 250 literals)
+	std::lognormal_distribution<double> size_distribution(2.0, 1.5);
+	std::vector<unsigned> sizes(state.range(0));
+	std::size_t elements = 0;
+	for(auto& size : sizes) {
+		size = 1 + std::min(static_cast<unsigned>(size_distribution(prng)), 1u << 12);
+		elements += size;
+	}
+
+	auto build = [&sizes](std::vector<kept_t>& population) {
+		population.reserve(sizes.size());
+		for(unsigned const size : sizes) {
+			vec_t clause;
+			for(unsigned i = 0; i < size; ++i) {
+				clause.push_back(i);
+			}
+			population.push_back(keep(clause, std::integral_constant<bool, freeze>()));
+		}
+	};
+
+	if(memory_probe::enabled) { // untimed replay of one iteration
+		memory_probe probe(state);
+		std::vector<kept_t> population;
+		build(population);
+		probe.record(sizes.size() * sizeof(kept_t), elements, sizeof(unsigned));
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		std::vector<kept_t> population;
+		build(population);
+		benchmark::DoNotOptimize(population.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * elements);
+}
+BENCHMARK_TEMPLATE(clause_population, 0, false)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, 0, true)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, -1, false)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, -1, true)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, -2, false)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, -2, true)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, 16, false)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(clause_population, 16, true)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+
+// Walks a buffer of clause-like buffers with memory_usage. The breakdown is reported as usage_* counters, next to the
+// heap_bytes that the memory probe measures for the same structure.
+template<std::size_t initial_size>
+static void nested_memory_usage(benchmark::State& state) {
+	using inner_t = new_buffer<unsigned, unsigned, initial_size>;
+	using outer_t = new_buffer<inner_t, unsigned, initial_size>;
+	std::mt19937_64 prng(SEED);
+	for(int i = 0; i <= 10000; ++i) {
+		prng();
+	}
+	std::lognormal_distribution<double> size_distribution(2.0, 1.5);
+
+	memory_probe probe(state);
+	outer_t outer;
+	std::size_t elements = 0;
+	for(std::int64_t i = 0; i < state.range(0); ++i) {
+		unsigned const size = 1 + std::min(static_cast<unsigned>(size_distribution(prng)), 1u << 12);
+		outer.emplace_back();
+		for(unsigned j = 0; j < size; ++j) {
+			outer.back().push_back(j);
+		}
+		elements += size;
+	}
+	probe.record(sizeof(outer), elements, sizeof(unsigned));
+
+	new_buffer_memory_usage const usage = outer.memory_usage();
+	new_buffer_usage_registry registry;
+	registry.add(outer);
+	assert(registry.total().heap_bytes == usage.heap_bytes && registry.total().slack_bytes == usage.slack_bytes);
+	state.counters["usage_object"] = static_cast<double>(usage.object_bytes);
+	state.counters["usage_heap"] = static_cast<double>(usage.heap_bytes);
+	state.counters["usage_slack"] = static_cast<double>(usage.slack_bytes);
+
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(outer.memory_usage());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(nested_memory_usage, 0)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(nested_memory_usage, -1)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(nested_memory_usage, -2)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+BENCHMARK_TEMPLATE(nested_memory_usage, 16)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<16);
+
+// An unlinked temporary file of random bytes, which stays in the page cache so that ingestion is bound by copying.
+class scratch_file {
+	int m_fd = -1;
+
+public:
+	explicit scratch_file(std::size_t size) {
+		char const* const directory = std::getenv("TMPDIR");
+		std::string path = std::string(directory ? directory : "/tmp") + "/new_buffer_bench.XXXXXX";
+		m_fd = mkstemp(&path[0]);
+		if(m_fd < 0) {
+			return;
+		}
+		unlink(path.c_str());
+		std::mt19937_64 prng(SEED);
+		std::vector<std::uint64_t> block(1 << 13);
+		for(std::size_t written = 0; written < size; ) {
+			for(auto& word : block) {
+				word = prng();
+			}
+			std::size_t const count = std::min(size - written, block.size() * sizeof(std::uint64_t));
+			if(write(m_fd, block.data(), count) != static_cast<ssize_t>(count)) {
+				close(m_fd);
+				m_fd = -1;
+				return;
+			}
+			written += count;
+		}
+	}
+	scratch_file(scratch_file const&) = delete;
+	scratch_file& operator=(scratch_file const&) = delete;
+	~scratch_file() {
+		if(m_fd >= 0) {
+			close(m_fd);
+		}
+	}
+
+	// rewound to the start
+	int fd() const {
+		lseek(m_fd, 0, SEEK_SET);
+		return m_fd;
+	}
+	bool valid() const { return m_fd >= 0; }
+};
+
+static constexpr std::size_t ingestion_chunk = 1 << 16;
+
+// reads the whole file with read_into, which writes straight into the buffer's spare capacity
+template<std::size_t initial_size>
+static void file_ingestion_read_into(benchmark::State& state) {
+	using vec_t = new_buffer<char, unsigned, initial_size>;
+	scratch_file const file(state.range(0));
+	if(!file.valid()) {
+		state.SkipWithError("cannot create a scratch file in $TMPDIR");
+		return;
+	}
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination;
+		int const fd = file.fd();
+		while(read_into(destination, fd, ingestion_chunk) > 0) {
+		}
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(file_ingestion_read_into, 0)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_into, -1)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_into, -2)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_into, 16)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_into, 1024)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+
+// reads the whole file into a temporary chunk and appends that to the buffer
+template<std::size_t initial_size>
+static void file_ingestion_read_append(benchmark::State& state) {
+	using vec_t = new_buffer<char, unsigned, initial_size>;
+	scratch_file const file(state.range(0));
+	if(!file.valid()) {
+		state.SkipWithError("cannot create a scratch file in $TMPDIR");
+		return;
+	}
+	std::vector<char> chunk(ingestion_chunk);
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t destination;
+		int const fd = file.fd();
+		for(ssize_t count; (count = read(fd, chunk.data(), chunk.size())) > 0; ) {
+			destination.append(static_cast<unsigned>(count), chunk.data());
+		}
+		benchmark::DoNotOptimize(destination.c_ptr());
+		benchmark::ClobberMemory();
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(file_ingestion_read_append, 0)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_append, -1)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_append, -2)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_append, 16)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+BENCHMARK_TEMPLATE(file_ingestion_read_append, 1024)->RangeMultiplier(GRANULARITY)->Range(1<<10, 1<<26);
+
+// A C-style API that hands out malloc'ed arrays and takes ownership of the arrays that are passed to it.
+__attribute__((noinline)) static unsigned* c_api_produce(std::size_t count) {
+	unsigned* const data = static_cast<unsigned*>(malloc(count * sizeof(unsigned)));
+	for(std::size_t i = 0; i < count; ++i) {
+		data[i] = static_cast<unsigned>(i);
+	}
+	return data;
+}
+
+__attribute__((noinline)) static void c_api_consume(unsigned* data, std::size_t size) {
+	benchmark::DoNotOptimize(data[size - 1]);
+	free(data);
+}
+
+// takes an array from the C API, appends an element and hands it back without copying
+template<std::size_t initial_size>
+static void c_api_roundtrip_adopt(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	unsigned const count = state.range(0);
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t buffer;
+		buffer.adopt(c_api_produce(count), count, count);
+		buffer.push_back(count);
+		unsigned const size = buffer.size();
+		c_api_consume(buffer.release(), size);
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK_TEMPLATE(c_api_roundtrip_adopt, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(c_api_roundtrip_adopt, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// like c_api_roundtrip_adopt, but copies the array into the buffer and back out
+template<std::size_t initial_size>
+static void c_api_roundtrip_copy(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	unsigned const count = state.range(0);
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		vec_t buffer;
+		unsigned* const produced = c_api_produce(count);
+		buffer.append(count, produced);
+		free(produced);
+		buffer.push_back(count);
+		unsigned* const consumed = static_cast<unsigned*>(malloc(buffer.size() * sizeof(unsigned)));
+		std::memcpy(consumed, buffer.c_ptr(), buffer.size() * sizeof(unsigned));
+		c_api_consume(consumed, buffer.size());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK_TEMPLATE(c_api_roundtrip_copy, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+BENCHMARK_TEMPLATE(c_api_roundtrip_copy, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<20);
+
+// The trace named by $BUFFER_TRACE, with buffer ids renumbered to storage slots such that buffers whose lifetimes do not
+// overlap share a slot. Buffers that are still alive at the end of the trace are destroyed explicitly.
+struct compiled_buffer_trace {
+	std::vector<buffer_trace_record> records;
+	std::uint32_t slots = 0;
+
+	static compiled_buffer_trace const& instance() {
+		static compiled_buffer_trace const trace = load(std::getenv("BUFFER_TRACE"));
+		return trace;
+	}
+
+private:
+	static compiled_buffer_trace load(char const* path) {
+		compiled_buffer_trace result;
+		if(path == nullptr || !read_buffer_trace(path, result.records)) {
+			result.records.clear();
+			return result;
+		}
+
+		std::uint32_t const unmapped = std::numeric_limits<std::uint32_t>::max();
+		std::vector<std::uint32_t> slot_of;
+		std::vector<std::uint32_t> free_slots;
+		auto const slot = [&](std::uint64_t id) -> std::uint32_t& {
+			if(id >= slot_of.size()) {
+				slot_of.resize(id + 1, unmapped);
+			}
+			return slot_of[id];
+		};
+		for(auto& record : result.records) {
+			std::uint32_t const id = record.id;
+			if(record.op == buffer_trace_op::construct || record.op == buffer_trace_op::copy) {
+				if(free_slots.empty()) {
+					slot(id) = result.slots++;
+				} else {
+					slot(id) = free_slots.back();
+					free_slots.pop_back();
+				}
+			}
+			if(record.op == buffer_trace_op::copy || record.op == buffer_trace_op::assign) {
+				record.argument = slot(record.argument);
+			}
+			record.id = slot(id);
+			if(record.op == buffer_trace_op::destroy) {
+				free_slots.push_back(record.id);
+				slot(id) = unmapped;
+			}
+		}
+		for(auto const s : slot_of) {
+			if(s != unmapped) {
+				buffer_trace_record record = buffer_trace_record();
+				record.id = s;
+				record.op = buffer_trace_op::destroy;
+				result.records.push_back(record);
+			}
+		}
+		return result;
+	}
+};
+
+// Replays a trace recorded with `recorded_buffer` (see buffer_trace.h), which is passed via $BUFFER_TRACE.
+template<std::size_t initial_size>
+static void trace_replay(benchmark::State& state) {
+	using vec_t = new_buffer<unsigned, unsigned, initial_size>;
+	using slot_t = typename std::aligned_storage<sizeof(vec_t), alignof(vec_t)>::type;
+	compiled_buffer_trace const& trace = compiled_buffer_trace::instance();
+	if(trace.records.empty()) {
+		state.SkipWithError("$BUFFER_TRACE does not name a trace recorded with recorded_buffer");
+		return;
+	}
+
+	std::vector<slot_t> slots(trace.slots);
+	auto const buffer = [&slots](std::uint64_t slot) -> vec_t& { return *reinterpret_cast<vec_t*>(&slots[slot]); };
+
+	measurement_scope measurement(state);
+	for(auto _ : state) {
+		unsigned sink = 0;
+		for(auto const& record : trace.records) {
+			switch(record.op) {
+			case buffer_trace_op::construct: ::new(&slots[record.id]) vec_t(); break;
+			case buffer_trace_op::destroy: buffer(record.id).~vec_t(); break;
+			case buffer_trace_op::push_back: buffer(record.id).push_back(record.id); break;
+			case buffer_trace_op::pop_back: buffer(record.id).pop_back(); break;
+			case buffer_trace_op::resize: buffer(record.id).resize(static_cast<unsigned>(record.argument)); break;
+			case buffer_trace_op::shrink: buffer(record.id).resize(static_cast<unsigned>(record.argument)); break;
+			case buffer_trace_op::copy: ::new(&slots[record.id]) vec_t(buffer(record.argument)); break;
+			case buffer_trace_op::index: sink ^= buffer(record.id)[static_cast<unsigned>(record.argument)]; break;
+			case buffer_trace_op::assign: buffer(record.id) = buffer(record.argument); break;
+			}
+		}
+		benchmark::DoNotOptimize(sink);
+	}
+	state.SetItemsProcessed(state.iterations() * trace.records.size());
 }
-BENCHMARK_TEMPLATE(simple_random_reads, 0)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_reads, -1)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_reads, -2)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_reads, 16)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
-BENCHMARK_TEMPLATE(simple_random_reads, 1024)->RangeMultiplier(GRANULARITY)->Range(1, 1<<30);
+BENCHMARK_TEMPLATE(trace_replay, 0)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(trace_replay, -1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(trace_replay, -2)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(trace_replay, 16)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(trace_replay, 1024)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(trace_replay, auto_simple)->Unit(benchmark::kMillisecond);
 
 BENCHMARK_MAIN();
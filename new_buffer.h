@@ -13,6 +13,29 @@
 #include <utility>
 #include <memory>
 #include <algorithm>
+#include <initializer_list>
+
+#if defined(__GNUC__)
+#define NEW_BUFFER_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define NEW_BUFFER_COLD __attribute__((noinline, cold))
+#else
+#define NEW_BUFFER_UNLIKELY(x) (x)
+#define NEW_BUFFER_COLD
+#endif
+
+#if defined(PROFILE_BUFFERS) && PROFILE_BUFFERS
+#include "new_buffer_profile.h"
+#define NEW_BUFFER_PROFILE(CODE) CODE
+#else
+#define NEW_BUFFER_PROFILE(CODE)
+#endif
+
+// the new_buffer:reallocate tracepoint, see util/usdt.h
+#if defined(USDT_PROBES) && USDT_PROBES
+#define NEW_BUFFER_USDT(CODE) CODE
+#else
+#define NEW_BUFFER_USDT(CODE)
+#endif
 
 namespace new_buffer_detail {
     // copy_into, move_into and destroy can reasonably be flattened to memcpy by the optimizer, we are just being paranoid here
@@ -89,11 +112,370 @@ namespace new_buffer_detail {
 #if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8
 #pragma GCC diagnostic pop // -Wclass-memaccess
 #endif
+
+    // bulk copies from pointers, element-wise copies from other iterators
+    template<typename T>
+    inline void copy_range_into(T* destination, T const* first, T const* last) {
+        copy_into(destination, first, static_cast<std::size_t>(last - first));
+    }
+
+    template<typename T>
+    inline void copy_range_into(T* destination, T* first, T* last) {
+        copy_into(destination, static_cast<T const*>(first), static_cast<std::size_t>(last - first));
+    }
+
+    template<typename T, typename ForwardIt>
+    inline void copy_range_into(T* destination, ForwardIt first, ForwardIt last) {
+        std::uninitialized_copy(first, last, destination);
+    }
+
+    // Copy-assigns over the live prefix, constructs only the tail and destroys only the excess, so that the elements
+    // keep resources such as the capacity of a std::string. Forward ranges are measured first, so that the buffer grows
+    // at most once.
+    template<typename Buffer, typename ForwardIt>
+    void assign(Buffer& buffer, ForwardIt first, ForwardIt last, std::forward_iterator_tag) {
+        using size_type = typename Buffer::size_type;
+        auto const count = static_cast<size_type>(std::distance(first, last));
+        if(count > buffer.capacity()) {
+            if(std::is_trivially_copyable<typename Buffer::value_type>::value) {
+                buffer.clear(); // nothing to reuse, so do not let the buffer move the old elements
+            }
+            buffer.ensure_capacity(count);
+        }
+        auto const size = buffer.size();
+        if(count <= size) {
+            std::copy(first, last, buffer.begin());
+            buffer.shrink(count);
+        } else {
+            ForwardIt middle = first;
+            std::advance(middle, size);
+            std::copy(first, middle, buffer.begin());
+            copy_range_into(buffer.grow_uninitialized(count - size), middle, last);
+            buffer.commit(count - size);
+        }
+    }
+
+    template<typename Buffer, typename InputIt>
+    void assign(Buffer& buffer, InputIt first, InputIt last, std::input_iterator_tag) {
+        using size_type = typename Buffer::size_type;
+        auto const size = buffer.size();
+        size_type index = 0;
+        for(; index < size && first != last; ++index, ++first) {
+            buffer.begin()[index] = *first;
+        }
+        buffer.shrink(index);
+        for(; first != last; ++first) {
+            buffer.emplace_back(*first);
+        }
+    }
+
+    // the in_place argument of the new_buffer:reallocate tracepoint; the old address is compared as an integer, since
+    // the old pointer is invalid once realloc has freed it
+    inline int usdt_placement(std::size_t old_capacity, std::uintptr_t old_address, void const* new_data) noexcept {
+        if(old_capacity == 0 || old_address == 0) {
+            return 2; // initial allocation, no elements to move
+        }
+        return old_address == reinterpret_cast<std::uintptr_t>(new_data) ? 1 : 0;
+    }
 }
 
+//----------------------------- memory accounting -----------------------------//
+
+// Bytes owned by a buffer, as returned by memory_usage. `object_bytes` is the buffer object itself, including inline
+// storage. `heap_bytes` is the usable size of its allocation as reported by the allocator, including headers.
+// `slack_bytes` is the part of both that could hold elements but does not: unused capacity, inline storage of a buffer
+// that has moved to the heap, and the rounding of the allocator. Nested buffers add their heap and slack bytes; their
+// object bytes are already part of the elements of the outer buffer.
+struct new_buffer_memory_usage {
+    std::size_t object_bytes = 0;
+    std::size_t heap_bytes = 0;
+    std::size_t slack_bytes = 0;
+
+    std::size_t total_bytes() const noexcept { return object_bytes + heap_bytes; }
+
+    new_buffer_memory_usage& operator+=(new_buffer_memory_usage const& other) noexcept {
+        object_bytes += other.object_bytes;
+        heap_bytes += other.heap_bytes;
+        slack_bytes += other.slack_bytes;
+        return *this;
+    }
+};
+
+namespace new_buffer_detail {
+    // heap and slack bytes of elements that report their own memory usage, i.e., nested buffers
+    template<typename T>
+    inline auto nested_memory_usage(T const* begin, T const* end, int) -> decltype(begin->memory_usage()) {
+        new_buffer_memory_usage result;
+        for(; begin < end; ++begin) {
+            new_buffer_memory_usage const nested = begin->memory_usage();
+            result.heap_bytes += nested.heap_bytes;
+            result.slack_bytes += nested.slack_bytes;
+        }
+        return result;
+    }
+
+    template<typename T>
+    inline new_buffer_memory_usage nested_memory_usage(T const* /*begin*/, T const* /*end*/, long) noexcept {
+        return new_buffer_memory_usage();
+    }
+
+    template<typename T>
+    inline new_buffer_memory_usage nested_memory_usage(T const* begin, T const* end) {
+        return nested_memory_usage(begin, end, 0);
+    }
+}
+
+//----------------------------- shrink policies -----------------------------//
+
+// Shrink policies for the optional last template parameter of new_buffer. The policy is applied whenever pop_back,
+// shrink, set_end or resize reduce the size; clear and reset keep the capacity for refilling.
+struct new_buffer_no_shrink {
+    static constexpr bool enabled = false;
+
+    template<typename SZ>
+    static SZ shrunk_capacity(SZ /*size*/, SZ capacity) noexcept { return capacity; }
+};
+
+// Halves the capacity while the size is below a quarter of it, but not below MIN_CAPACITY, at which it stops even if
+// halving would overshoot. A buffer that has just been shrunk is at most half full, so push/pop oscillation around a
+// threshold does not reallocate every time.
+template<std::size_t MIN_CAPACITY = 16>
+struct new_buffer_hysteresis_shrink {
+    static_assert(MIN_CAPACITY > 0, "the header-in-heap layout cannot represent an allocation without capacity");
+
+    static constexpr bool enabled = true;
+
+    template<typename SZ>
+    static SZ shrunk_capacity(SZ size, SZ capacity) noexcept {
+        while(capacity > MIN_CAPACITY && size < capacity / 4) {
+            capacity = capacity / 2 > MIN_CAPACITY ? capacity / 2 : static_cast<SZ>(MIN_CAPACITY);
+        }
+        return capacity;
+    }
+};
+
+//----------------------------- non-owning view of consecutive elements -----------------------------//
+
+template<typename T, typename SZ, std::size_t INITIAL_SIZE, typename SHRINK = new_buffer_no_shrink>
+class new_buffer;
+
+// A pointer and a size, e.g., to pass "elements 10..50" of a buffer without copying them. Spans convert implicitly from
+// every new_buffer specialization with the same size_type; use buffer_span<T const, SZ> for read-only views.
+template<typename T, typename SZ>
+class buffer_span {
+public:
+    using element_type = T;
+    using value_type = typename std::remove_cv<T>::type;
+    using size_type = SZ;
+    using difference_type = std::ptrdiff_t;
+    using reference = element_type&;
+    using pointer = element_type*;
+    using iterator = pointer;
+    using const_iterator = pointer;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+
+private:
+    pointer m_data = nullptr;
+    size_type m_size = 0;
+
+public:
+    constexpr buffer_span() noexcept = default;
+    constexpr buffer_span(pointer data, size_type size) noexcept : m_data(data), m_size(size) { }
+
+    template<std::size_t INITIAL_SIZE, typename SHRINK>
+    buffer_span(new_buffer<value_type, SZ, INITIAL_SIZE, SHRINK>& buffer) noexcept : m_data(buffer.begin()), m_size(buffer.size()) { }
+
+    template<std::size_t INITIAL_SIZE, typename SHRINK, typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+    buffer_span(new_buffer<value_type, SZ, INITIAL_SIZE, SHRINK> const& buffer) noexcept : m_data(buffer.begin()), m_size(buffer.size()) { }
+
+    template<typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value && sizeof(U) == sizeof(T)>::type>
+    constexpr buffer_span(buffer_span<U, SZ> const& other) noexcept : m_data(other.data()), m_size(other.size()) { }
+
+    constexpr bool empty() const noexcept { return m_size == 0; }
+    constexpr size_type size() const noexcept { return m_size; }
+    constexpr pointer data() const noexcept { return m_data; }
+
+    constexpr iterator begin() const noexcept { return m_data; }
+    constexpr iterator end() const noexcept { return m_data + m_size; }
+    constexpr const_iterator cbegin() const noexcept { return m_data; }
+    constexpr const_iterator cend() const noexcept { return m_data + m_size; }
+    reverse_iterator rbegin() const noexcept { return reverse_iterator(end()); }
+    reverse_iterator rend() const noexcept { return reverse_iterator(begin()); }
+
+    reference operator[](size_type index) const {
+        SASSERT(index < m_size);
+        return m_data[index];
+    }
+
+    reference front() const {
+        SASSERT(!empty());
+        return m_data[0];
+    }
+
+    reference back() const {
+        SASSERT(!empty());
+        return m_data[m_size - 1];
+    }
+
+    buffer_span subspan(size_type offset, size_type count) const {
+        SASSERT(offset <= m_size && count <= m_size - offset);
+        return buffer_span(m_data + offset, count);
+    }
+
+    buffer_span first(size_type count) const { return subspan(0, count); }
+    buffer_span last(size_type count) const { return subspan(m_size - count, count); }
+
+    bool contains(value_type const& element) const { return std::find(begin(), end(), element) != end(); }
+};
+
+//----------------------------- immutable buffer of exactly size() elements -----------------------------//
+
+// Result of new_buffer::freeze, for buffers that are built once and then kept for a long time (e.g., learned clauses).
+// Like the header-in-heap layout, it is a single pointer to one allocation of a header and the elements, but the header
+// only stores the size and the allocation holds exactly size() elements, so none of the slack of geometric growth is
+// kept. thaw turns it back into a growable new_buffer with one allocation and a move of the elements.
+template<typename T, typename SZ>
+class frozen_buffer {
+    static_assert(std::numeric_limits<SZ>::is_integer, "SZ must be an unsigned integer type of reasonable size");
+    static_assert(!std::numeric_limits<SZ>::is_signed, "SZ must be an unsigned integer type of reasonable size");
+
+    template<typename, typename, std::size_t, typename>
+    friend class new_buffer;
+
+public:
+    using value_type = T;
+    using size_type = SZ;
+    using difference_type = std::ptrdiff_t;
+    using const_reference = value_type const&;
+    using const_pointer = value_type const*;
+    using const_iterator = const_pointer;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+private:
+    struct alignas(alignof(value_type)) header_t {
+        size_type m_size;
+    };
+
+    char* m_data = nullptr;
+
+    header_t const* header() const noexcept {
+        SASSERT(m_data);
+        return reinterpret_cast<header_t const*>(m_data - sizeof(header_t));
+    }
+
+    value_type* ptr() const noexcept { return reinterpret_cast<value_type*>(m_data); }
+
+    // move constructs the `count` elements at `source`, which still have to be destroyed by the caller
+    frozen_buffer(value_type* source, size_type count) {
+        if(count > 0) {
+            header_t* const new_header = reinterpret_cast<header_t*>(memory::allocate(sizeof(header_t) + static_cast<std::size_t>(count) * sizeof(value_type)));
+            new_header->m_size = count;
+            m_data = reinterpret_cast<char*>(new_header) + sizeof(header_t);
+            new_buffer_detail::move_into(ptr(), source, count);
+        }
+    }
+
+    void release() noexcept {
+        if(m_data) {
+            new_buffer_detail::destroy(ptr(), ptr() + size());
+            memory::deallocate(m_data - sizeof(header_t));
+            m_data = nullptr;
+        }
+    }
+
+public:
+    constexpr frozen_buffer() noexcept = default;
+
+    frozen_buffer(frozen_buffer const& other) {
+        auto const count = other.size();
+        if(count > 0) {
+            header_t* const new_header = reinterpret_cast<header_t*>(memory::allocate(sizeof(header_t) + static_cast<std::size_t>(count) * sizeof(value_type)));
+            new_header->m_size = count;
+            m_data = reinterpret_cast<char*>(new_header) + sizeof(header_t);
+            new_buffer_detail::copy_into(ptr(), other.ptr(), count);
+        }
+    }
+
+    frozen_buffer& operator=(frozen_buffer const& other) {
+        if(this != &other) {
+            frozen_buffer copy(other);
+            swap(*this, copy);
+        }
+        return *this;
+    }
+
+    frozen_buffer(frozen_buffer&& other) noexcept : m_data(other.m_data) { other.m_data = nullptr; }
+    frozen_buffer& operator=(frozen_buffer&& other) noexcept {
+        using std::swap;
+        swap(m_data, other.m_data);
+        return *this;
+    }
+
+    friend void swap(frozen_buffer& lhs, frozen_buffer& rhs) noexcept {
+        using std::swap;
+        swap(lhs.m_data, rhs.m_data);
+    }
+
+    ~frozen_buffer() { release(); }
+
+    // Moves the elements into a new_buffer with a capacity of exactly size() and leaves this buffer empty.
+    template<std::size_t INITIAL_SIZE = 0, typename SHRINK = new_buffer_no_shrink>
+    new_buffer<value_type, size_type, INITIAL_SIZE, SHRINK> thaw() {
+        new_buffer<value_type, size_type, INITIAL_SIZE, SHRINK> result;
+        auto const count = size();
+        if(count > 0) {
+            result.ensure_capacity(count);
+            new_buffer_detail::move_into(result.grow_uninitialized(count), ptr(), count);
+            result.commit(count);
+            release();
+        }
+        return result;
+    }
+
+    bool empty() const noexcept { return m_data == nullptr; }
+    size_type size() const noexcept { return m_data ? header()->m_size : 0; }
+
+    new_buffer_memory_usage memory_usage() const {
+        new_buffer_memory_usage result = new_buffer_detail::nested_memory_usage(ptr(), ptr() + size());
+        result.object_bytes = sizeof(*this);
+        if(m_data) {
+            std::size_t const heap_bytes = memory::usable_size(m_data - sizeof(header_t));
+            result.heap_bytes += heap_bytes;
+            result.slack_bytes += heap_bytes - sizeof(header_t) - static_cast<std::size_t>(size()) * sizeof(value_type);
+        }
+        return result;
+    }
+
+    const_pointer c_ptr() const noexcept { return ptr(); }
+
+    const_iterator begin() const noexcept { return ptr(); }
+    const_iterator end() const noexcept { return ptr() + size(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+
+    const_reference operator[](size_type index) const {
+        SASSERT(index < size());
+        return ptr()[index];
+    }
+
+    const_reference front() const {
+        SASSERT(!empty());
+        return ptr()[0];
+    }
+
+    const_reference back() const {
+        SASSERT(!empty());
+        return ptr()[size() - 1];
+    }
+
+    operator buffer_span<value_type const, size_type>() const noexcept { return buffer_span<value_type const, size_type>(ptr(), size()); }
+};
+
 //----------------------------- vector that stores INITIAL_SIZE elements locally -----------------------------//
 
-template<typename T, typename SZ, std::size_t INITIAL_SIZE>
+template<typename T, typename SZ, std::size_t INITIAL_SIZE, typename SHRINK>
 class new_buffer {
     static_assert(std::numeric_limits<SZ>::is_integer, "SZ must be an unsigned integer type of reasonable size");
     static_assert(!std::numeric_limits<SZ>::is_signed, "SZ must be an unsigned integer type of reasonable size");
@@ -124,6 +506,7 @@ private:
     size_type m_size = 0;
     size_type m_capacity = initial_size;
     initial_buffer_type m_initial_buffer;
+    NEW_BUFFER_PROFILE(new_buffer_profile::tag<T> m_profile;)
 
     inline pointer ptr() noexcept { return m_data; }
     inline const_pointer ptr() const noexcept { return m_data; }
@@ -136,10 +519,42 @@ private:
         // return 2 * capacity();
     }
 
+    // kept out of line, so that push_back only inlines the capacity check
+    NEW_BUFFER_COLD void grow() {
+        reallocate(next_capacity());
+    }
+
+    // applies the shrink policy after the size has gone down, moving back into the inline buffer whenever the policy
+    // shrinks a heap allocation and the elements fit, even if the policy would have kept more than initial_size
+    void maybe_shrink() {
+        if(SHRINK::enabled && m_data != reinterpret_cast<pointer>(&m_initial_buffer)) {
+            size_type const new_capacity = SHRINK::shrunk_capacity(size(), capacity());
+            if(NEW_BUFFER_UNLIKELY(new_capacity < capacity())) {
+                if(size() <= initial_size) {
+                    move_to_initial_buffer();
+                } else {
+                    reallocate(new_capacity);
+                }
+            }
+        }
+    }
+
+    // requires a heap allocation and at most initial_size elements
+    void move_to_initial_buffer() {
+        SASSERT(m_data != reinterpret_cast<pointer>(&m_initial_buffer) && m_size <= initial_size);
+        new_buffer_detail::move_into(reinterpret_cast<pointer>(&m_initial_buffer), m_data, m_size);
+        new_buffer_detail::destroy(m_data, m_data + m_size);
+        memory::deallocate(m_data);
+        m_data = reinterpret_cast<pointer>(&m_initial_buffer);
+        m_capacity = initial_size;
+    }
+
     template<typename U = value_type>
     typename std::enable_if<std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value && std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type const new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         std::size_t const new_bytesize = static_cast<std::size_t>(new_capacity) * sizeof(value_type);
 
         if(m_data != reinterpret_cast<pointer>(&m_initial_buffer)) {
@@ -150,12 +565,15 @@ private:
             m_data = new_buffer;
         }
         m_capacity = new_capacity;
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), static_cast<long long>(INITIAL_SIZE)););
     }
 
     template<typename U = value_type>
     typename std::enable_if<!std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value || !std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type const new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         std::size_t const new_bytesize = static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         pointer const new_buffer = reinterpret_cast<pointer>(memory::allocate(new_bytesize));
 
@@ -167,6 +585,7 @@ private:
 
         m_data = new_buffer;
         m_capacity = new_capacity;
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), static_cast<long long>(INITIAL_SIZE)););
     }
 
 public:
@@ -179,6 +598,7 @@ public:
             m_data = reinterpret_cast<pointer>(&m_initial_buffer);
             m_capacity = initial_size;
         } else {
+            NEW_BUFFER_PROFILE(m_profile.on_reallocate(0, initial_size, pos););
             m_data = reinterpret_cast<pointer>(memory::allocate(static_cast<std::size_t>(pos) * sizeof(value_type)));
             m_capacity = pos;
         }
@@ -187,14 +607,35 @@ public:
 
     new_buffer& operator=(new_buffer const& other) {
         if(this != &other) {
-            clear();
-            reserve(other.m_size);
-            m_size = other.m_size;
-            new_buffer_detail::copy_into(m_data, other.m_data, m_size);
+            assign(other.begin(), other.end());
         }
         return *this;
     }
 
+    // [first, last) must not point into this buffer
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void assign(InputIt first, InputIt last) {
+        new_buffer_detail::assign(*this, first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+
+    void assign(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
+    new_buffer& operator=(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+        return *this;
+    }
+
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    new_buffer(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    new_buffer(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
     // Depending on initial_size, move construction may still be very expensive
     new_buffer(new_buffer&& other) {
         if(other.m_data != reinterpret_cast<pointer>(&other.m_initial_buffer)) {
@@ -242,6 +683,7 @@ public:
     }
 
     ~new_buffer() {
+        NEW_BUFFER_PROFILE(m_profile.on_destroy(size()););
         new_buffer_detail::destroy(begin(), end());
         if(m_data != reinterpret_cast<pointer>(&m_initial_buffer)) {
             memory::deallocate(m_data);
@@ -254,6 +696,7 @@ public:
             m_data = reinterpret_cast<pointer>(&m_initial_buffer);
             m_capacity = initial_size;
         } else {
+            NEW_BUFFER_PROFILE(m_profile.on_reallocate(0, initial_size, count););
             m_data = reinterpret_cast<pointer>(memory::allocate(static_cast<std::size_t>(count) * sizeof(value_type)));
             m_capacity = count;
         }
@@ -311,6 +754,20 @@ public:
     size_type size() const noexcept { return m_size; }
     size_type capacity() const noexcept { return m_capacity; }
 
+    // the inline storage counts as slack while the elements live on the heap
+    new_buffer_memory_usage memory_usage() const {
+        new_buffer_memory_usage result = new_buffer_detail::nested_memory_usage(ptr(), ptr() + size());
+        result.object_bytes = sizeof(*this);
+        if(m_data != reinterpret_cast<const_pointer>(&m_initial_buffer)) {
+            std::size_t const heap_bytes = memory::usable_size(m_data);
+            result.heap_bytes += heap_bytes;
+            result.slack_bytes += static_cast<std::size_t>(initial_size) * sizeof(value_type) + heap_bytes - static_cast<std::size_t>(size()) * sizeof(value_type);
+        } else {
+            result.slack_bytes += static_cast<std::size_t>(initial_size - size()) * sizeof(value_type);
+        }
+        return result;
+    }
+
     void clear() noexcept {
         new_buffer_detail::destroy(begin(), end());
         m_size = 0;
@@ -325,6 +782,7 @@ public:
             ::new(ptr + i) value_type();
         }
         m_size = count;
+        maybe_shrink();
     }
 
     void resize(size_type count, value_type const& value) {
@@ -336,6 +794,7 @@ public:
             ::new(ptr + i) value_type(value);
         }
         m_size = count;
+        maybe_shrink();
     }
 
     void reserve(size_type new_capacity) {
@@ -347,9 +806,7 @@ public:
     void shrink_to_fit() {
         if(m_size <= initial_size) {
             if(m_data != reinterpret_cast<pointer>(&m_initial_buffer)) {
-                new_buffer_detail::move_into(reinterpret_cast<pointer>(&m_initial_buffer), m_data, m_size);
-                memory::deallocate(m_data);
-                m_data = reinterpret_cast<pointer>(&m_initial_buffer);
+                move_to_initial_buffer();
             }
         } else {
             if(size() < capacity()) {
@@ -358,6 +815,14 @@ public:
         }
     }
 
+    // Moves the elements into an exact-size immutable buffer and releases the storage of this one, which is left empty.
+    frozen_buffer<value_type, size_type> freeze() {
+        frozen_buffer<value_type, size_type> result(ptr(), size());
+        clear();
+        shrink_to_fit();
+        return result;
+    }
+
     reference operator[](size_type index) {
         SASSERT(index < size());
         return ptr()[index];
@@ -406,8 +871,8 @@ public:
 
     void push_back(value_type const& value) {
         auto const size = this->size();
-        if(size >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size >= capacity())) {
+            grow();
         }
         ::new(ptr() + size) value_type(value);
         ++m_size;
@@ -415,8 +880,8 @@ public:
 
     void push_back(value_type&& value) {
         auto const size = this->size();
-        if(size >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size >= capacity())) {
+            grow();
         }
         ::new(ptr() + size) value_type(std::move(value));
         ++m_size;
@@ -425,17 +890,60 @@ public:
     template<typename... Args>
     void emplace_back(Args&&... args) {
         auto const size = this->size();
-        if(size >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size >= capacity())) {
+            grow();
         }
         ::new(ptr() + size) value_type(std::forward<Args>(args)...);
         ++m_size;
     }
 
+    // grows the capacity without changing the size, unlike reserve in the old vector interface
+    void ensure_capacity(size_type new_capacity) {
+        if(capacity() < new_capacity) {
+            reallocate(new_capacity);
+        }
+    }
+
+    // for loops that have called ensure_capacity up front
+    void push_back_unchecked(value_type const& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(value);
+        ++m_size;
+    }
+
+    void push_back_unchecked(value_type&& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(std::move(value));
+        ++m_size;
+    }
+
+    template<typename... Args>
+    void emplace_back_unchecked(Args&&... args) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(std::forward<Args>(args)...);
+        ++m_size;
+    }
+
+    // Returns `count` slots of spare capacity behind the last element, which the caller constructs in place and then
+    // publishes with `commit`. Growing again before committing discards the slots.
+    pointer grow_uninitialized(size_type count) {
+        if(NEW_BUFFER_UNLIKELY(capacity() - size() < count)) {
+            reallocate(std::max<size_type>(size() + count, next_capacity()));
+        }
+        return ptr() + size();
+    }
+
+    // publishes the first `count` slots returned by grow_uninitialized, which must have been constructed
+    void commit(size_type count) {
+        SASSERT(count <= capacity() - size());
+        m_size += count;
+    }
+
     void pop_back() {
         SASSERT(!empty()); 
-        end()->~value_type();
         --m_size;
+        end()->~value_type();
+        maybe_shrink();
     }
 
     // adaptors for the old buffer interface
@@ -450,20 +958,25 @@ public:
     pointer c_ptr() const { return m_data; } // breaks logical const-ness, prefer data() [which is disabled due to the data type]
 
     void append(unsigned n, T const * elems) {
-        for (unsigned i = 0; i < n; i++) {
-            push_back(elems[i]);
+        if(n > 0) { // `elems` may be the null data of an empty heap buffer, which memcpy must not see even for 0 bytes
+            new_buffer_detail::copy_into(grow_uninitialized(n), elems, n);
+            commit(n);
         }
     }
 
     void append(const new_buffer& source) {
         append(source.size(), source.ptr());
     }
+
+    void append(buffer_span<value_type const, size_type> source) {
+        append(source.size(), source.data());
+    }
 };
 
 //----------------------------- vector that stores everything on the heap -----------------------------//
 
-template<typename T, typename SZ>
-class new_buffer<T, SZ, 0> {
+template<typename T, typename SZ, typename SHRINK>
+class new_buffer<T, SZ, 0, SHRINK> {
     static_assert(std::numeric_limits<SZ>::is_integer, "SZ must be an unsigned integer type of reasonable size");
     static_assert(!std::numeric_limits<SZ>::is_signed, "SZ must be an unsigned integer type of reasonable size");
     static_assert(std::numeric_limits<SZ>::digits >= 8, "SZ must be an unsigned integer type of reasonable size");
@@ -491,6 +1004,7 @@ private:
     };
 
     char* m_data = nullptr;
+    NEW_BUFFER_PROFILE(new_buffer_profile::tag<T> m_profile;)
 
     header_t* header() noexcept {
         SASSERT(m_data);
@@ -511,10 +1025,27 @@ private:
         return cap == 0 ? 2 : (3 * cap + 1) / 2;
     }
 
+    // kept out of line, so that push_back only inlines the capacity check
+    NEW_BUFFER_COLD void grow() {
+        reallocate(next_capacity());
+    }
+
+    // applies the shrink policy after the size has gone down
+    void maybe_shrink() {
+        if(SHRINK::enabled) {
+            size_type const new_capacity = SHRINK::shrunk_capacity(size(), capacity());
+            if(NEW_BUFFER_UNLIKELY(new_capacity < capacity())) {
+                reallocate(new_capacity);
+            }
+        }
+    }
+
     template<typename U = value_type>
     typename std::enable_if<std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value && std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type const new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         SASSERT(new_capacity > 0);
         std::size_t const new_bytesize = sizeof(header_t) + static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         header_t* new_header = nullptr;
@@ -530,12 +1061,15 @@ private:
             new_header->m_capacity = new_capacity;
         }
         m_data = reinterpret_cast<char*>(new_header) + sizeof(header_t);
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), 0););
     }
 
     template<typename U = value_type>
     typename std::enable_if<!std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value || !std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type const new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         SASSERT(new_capacity > 0);
         std::size_t const new_bytesize = sizeof(header_t) + static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         header_t* const new_header = reinterpret_cast<header_t*>(memory::allocate(new_bytesize));
@@ -551,6 +1085,7 @@ private:
             memory::deallocate(header());
         }
         m_data = reinterpret_cast<char*>(new_header) + sizeof(header_t);
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), 0););
     }
 
 public:
@@ -567,17 +1102,35 @@ public:
 
     new_buffer& operator=(new_buffer const& other) {
         if(this != &other) {
-            clear();
-            auto const size = other.size();
-            if(size > 0) {
-                reallocate(size);
-                new_buffer_detail::copy_into(ptr(), other.ptr(), size);
-                header()->m_size = size;
-            }
+            assign(other.begin(), other.end());
         }
         return *this;
     }
 
+    // [first, last) must not point into this buffer
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void assign(InputIt first, InputIt last) {
+        new_buffer_detail::assign(*this, first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+
+    void assign(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
+    new_buffer& operator=(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+        return *this;
+    }
+
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    new_buffer(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    new_buffer(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
     new_buffer(new_buffer&& other) : m_data(other.m_data) { other.m_data = nullptr; }
     new_buffer& operator=(new_buffer&& other) {
         using std::swap;
@@ -591,6 +1144,7 @@ public:
     }
 
     ~new_buffer() {
+        NEW_BUFFER_PROFILE(m_profile.on_destroy(size()););
         if(m_data) {
             new_buffer_detail::destroy(begin(), end());
             memory::deallocate(header());
@@ -614,6 +1168,18 @@ public:
     size_type size() const noexcept { return m_data ? header()->m_size : 0; }
     size_type capacity() const noexcept { return m_data ? header()->m_capacity : 0; }
 
+    // the header is part of the heap bytes, but not of the slack
+    new_buffer_memory_usage memory_usage() const {
+        new_buffer_memory_usage result = new_buffer_detail::nested_memory_usage(ptr(), ptr() + size());
+        result.object_bytes = sizeof(*this);
+        if(m_data) {
+            std::size_t const heap_bytes = memory::usable_size(m_data - sizeof(header_t));
+            result.heap_bytes += heap_bytes;
+            result.slack_bytes += heap_bytes - sizeof(header_t) - static_cast<std::size_t>(size()) * sizeof(value_type);
+        }
+        return result;
+    }
+
     void clear() noexcept {
         if(m_data != nullptr) {
             new_buffer_detail::destroy(ptr(), ptr() + size());
@@ -633,6 +1199,7 @@ public:
             }
             header()->m_size = count;
         }
+        maybe_shrink();
     }
 
     void resize(size_type count, value_type const& value) {
@@ -647,6 +1214,7 @@ public:
             }
             header()->m_size = count;
         }
+        maybe_shrink();
     }
 
     // vector::reserve actually does an enlarge-only resize as per the old API
@@ -672,6 +1240,14 @@ public:
         }
     }
 
+    // Moves the elements into an exact-size immutable buffer and releases the storage of this one, which is left empty.
+    frozen_buffer<value_type, size_type> freeze() {
+        frozen_buffer<value_type, size_type> result(ptr(), size());
+        clear();
+        shrink_to_fit();
+        return result;
+    }
+
     reference operator[](size_type index) {
         SASSERT(index < size());
         return ptr()[index];
@@ -720,8 +1296,8 @@ public:
 
     void push_back(value_type const& value) {
         auto const size = this->size();
-        if(size >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size >= capacity())) {
+            grow();
         }
         ::new(ptr() + size) value_type(value);
         ++header()->m_size;
@@ -729,8 +1305,8 @@ public:
 
     void push_back(value_type&& value) {
         auto const size = this->size();
-        if(size >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size >= capacity())) {
+            grow();
         }
         ::new(ptr() + size) value_type(std::move(value));
         ++header()->m_size;
@@ -739,17 +1315,62 @@ public:
     template<typename... Args>
     void emplace_back(Args&&... args) {
         auto const size = this->size();
-        if(size >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size >= capacity())) {
+            grow();
         }
         ::new(ptr() + size) value_type(std::forward<Args>(args)...);
         ++header()->m_size;
     }
 
+    // grows the capacity without changing the size, unlike reserve in the old vector interface
+    void ensure_capacity(size_type new_capacity) {
+        if(capacity() < new_capacity) {
+            reallocate(new_capacity);
+        }
+    }
+
+    // for loops that have called ensure_capacity up front
+    void push_back_unchecked(value_type const& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + header()->m_size) value_type(value);
+        ++header()->m_size;
+    }
+
+    void push_back_unchecked(value_type&& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + header()->m_size) value_type(std::move(value));
+        ++header()->m_size;
+    }
+
+    template<typename... Args>
+    void emplace_back_unchecked(Args&&... args) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + header()->m_size) value_type(std::forward<Args>(args)...);
+        ++header()->m_size;
+    }
+
+    // Returns `count` slots of spare capacity behind the last element, which the caller constructs in place and then
+    // publishes with `commit`. Growing again before committing discards the slots.
+    pointer grow_uninitialized(size_type count) {
+        if(NEW_BUFFER_UNLIKELY(capacity() - size() < count)) {
+            reallocate(std::max<size_type>(size() + count, next_capacity()));
+        }
+        return ptr() + size();
+    }
+
+    // publishes the first `count` slots returned by grow_uninitialized, which must have been constructed
+    void commit(size_type count) {
+        SASSERT(count <= capacity() - size());
+        if(count > 0) {
+            header()->m_size += count;
+        }
+    }
+
     void pop_back() {
         SASSERT(!empty()); 
-        end()->~value_type();
         --header()->m_size;
+        end()->~value_type();
+        maybe_shrink();
     }
 
     iterator erase(const_iterator position) {
@@ -794,6 +1415,7 @@ public:
             new_buffer_detail::destroy(ptr() + count, ptr() + size());
             header()->m_size = count;
         }
+        maybe_shrink();
     }
     void set_end(iterator it) {
         if(m_data != nullptr) {
@@ -803,6 +1425,7 @@ public:
         } else {
             SASSERT(it == nullptr);
         }
+        maybe_shrink();
     }
 
     // emplace_resize
@@ -819,6 +1442,7 @@ public:
             }
             header()->m_size = count;
         }
+        maybe_shrink();
     }
 
     pointer c_ptr() const noexcept { return m_data ? reinterpret_cast<value_type*>(m_data) : nullptr; } // breaks logical const-ness, prefer data() [which is disabled due to the data type]
@@ -829,8 +1453,9 @@ public:
     }
 
     void append(unsigned n, T const * elems) {
-        for (unsigned i = 0; i < n; i++) {
-            push_back(elems[i]);
+        if(n > 0) { // without a header, the data of an empty buffer is null, which memcpy must not see even for 0 bytes
+            new_buffer_detail::copy_into(grow_uninitialized(n), elems, n);
+            commit(n);
         }
     }
 
@@ -838,6 +1463,10 @@ public:
         append(source.size(), source.ptr());
     }
 
+    void append(buffer_span<value_type const, size_type> source) {
+        append(source.size(), source.data());
+    }
+
     void reserve(size_type count) {
         if(count > size()) {
             resize(count);
@@ -852,8 +1481,8 @@ public:
 };
 
 //----------------------------- vector that stores its size and capacity locally -----------------------------//
-template<typename T, typename SZ>
-class new_buffer<T, SZ, -1> {
+template<typename T, typename SZ, typename SHRINK>
+class new_buffer<T, SZ, -1, SHRINK> {
     static_assert(std::numeric_limits<SZ>::is_integer, "SZ must be an unsigned integer type of reasonable size");
     static_assert(!std::numeric_limits<SZ>::is_signed, "SZ must be an unsigned integer type of reasonable size");
     static_assert(std::numeric_limits<SZ>::digits >= 8, "SZ must be an unsigned integer type of reasonable size");
@@ -878,6 +1507,7 @@ private:
     pointer m_data = nullptr;
     size_type m_size = 0;
     size_type m_capacity = 0;
+    NEW_BUFFER_PROFILE(new_buffer_profile::tag<T> m_profile;)
 
     // ptr should really be public and called "data"
     pointer ptr() noexcept { return m_data; }
@@ -888,10 +1518,27 @@ private:
         return cap == 0 ? 2 : (3 * cap + 1) / 2;
     }
 
+    // kept out of line, so that push_back only inlines the capacity check
+    NEW_BUFFER_COLD void grow() {
+        reallocate(next_capacity());
+    }
+
+    // applies the shrink policy after the size has gone down
+    void maybe_shrink() {
+        if(SHRINK::enabled) {
+            size_type const new_capacity = SHRINK::shrunk_capacity(size(), capacity());
+            if(NEW_BUFFER_UNLIKELY(new_capacity < capacity())) {
+                reallocate(new_capacity);
+            }
+        }
+    }
+
     template<typename U = value_type>
     typename std::enable_if<std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value && std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type const new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         SASSERT(new_capacity > 0);
         std::size_t const new_bytesize = static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         if(m_data == nullptr) { // memory::reallocate does not support realloc(0)
@@ -901,12 +1548,15 @@ private:
             m_data = reinterpret_cast<pointer>(memory::reallocate(m_data, new_bytesize));
             m_capacity = new_capacity;
         }
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), -1););
     }
 
     template<typename U = value_type>
     typename std::enable_if<!std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value || !std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         SASSERT(new_capacity > 0);
         std::size_t const new_bytesize = static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         auto const new_data = reinterpret_cast<pointer>(memory::allocate(new_bytesize));
@@ -917,6 +1567,7 @@ private:
         }
         m_data = new_data;
         m_capacity = new_capacity;
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), -1););
     }
 
 public:
@@ -933,17 +1584,35 @@ public:
 
     new_buffer& operator=(new_buffer const& other) {
         if(this != &other) {
-            clear();
-            auto const size = other.m_size;
-            if(size > 0) {
-                reallocate(size);
-                new_buffer_detail::copy_into(ptr(), other.ptr(), size);
-                m_size = size;
-            }
+            assign(other.begin(), other.end());
         }
         return *this;
     }
 
+    // [first, last) must not point into this buffer
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void assign(InputIt first, InputIt last) {
+        new_buffer_detail::assign(*this, first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+
+    void assign(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
+    new_buffer& operator=(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+        return *this;
+    }
+
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    new_buffer(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    new_buffer(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
     new_buffer(new_buffer&& other) : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity) {
         other.m_data = nullptr;
         other.m_size = 0;
@@ -966,6 +1635,7 @@ public:
     }
 
     ~new_buffer() {
+        NEW_BUFFER_PROFILE(m_profile.on_destroy(size()););
         if(m_data) { // TODO: find out if memory::deallocate supports free(NULL)
             new_buffer_detail::destroy(begin(), end());
             memory::deallocate(m_data);
@@ -973,6 +1643,32 @@ public:
         }
     }
 
+    // Takes ownership of `data`, which holds `size` constructed elements in a block of `capacity` elements that has been
+    // allocated with malloc or memory::allocate. The current contents are destroyed.
+    void adopt(pointer data, size_type size, size_type capacity) {
+        SASSERT(size <= capacity);
+        SASSERT(data != nullptr || capacity == 0);
+        if(m_data) {
+            new_buffer_detail::destroy(begin(), end());
+            memory::deallocate(m_data);
+        }
+        m_data = data;
+        m_size = size;
+        m_capacity = capacity;
+        memory::adopted(data, static_cast<std::size_t>(capacity) * sizeof(value_type));
+    }
+
+    // Gives up ownership of the block, which the caller frees with free or memory::deallocate. Query size() and
+    // capacity() first, the buffer is left empty.
+    pointer release() noexcept {
+        pointer const data = m_data;
+        memory::released(data);
+        m_data = nullptr;
+        m_size = 0;
+        m_capacity = 0;
+        return data;
+    }
+
     // FIXME: src/muz/pdr/pdr_context.cpp relies on this constructor being implicit
     /* explicit */ new_buffer(size_type count) { resize(count); }
     new_buffer(size_type count, value_type const& element) { resize(count, element); }
@@ -989,6 +1685,17 @@ public:
     size_type size() const noexcept { return m_size; }
     size_type capacity() const noexcept { return m_capacity; }
 
+    new_buffer_memory_usage memory_usage() const {
+        new_buffer_memory_usage result = new_buffer_detail::nested_memory_usage(ptr(), ptr() + size());
+        result.object_bytes = sizeof(*this);
+        if(m_data) {
+            std::size_t const heap_bytes = memory::usable_size(m_data);
+            result.heap_bytes += heap_bytes;
+            result.slack_bytes += heap_bytes - static_cast<std::size_t>(size()) * sizeof(value_type);
+        }
+        return result;
+    }
+
     void clear() noexcept {
         new_buffer_detail::destroy(ptr(), ptr() + size());
         m_size = 0;
@@ -1001,6 +1708,7 @@ public:
             ::new(ptr() + i) value_type();
         }
         m_size = count;
+        maybe_shrink();
     }
 
     void resize(size_type count, value_type const& value) {
@@ -1010,6 +1718,7 @@ public:
             ::new(ptr() + i) value_type(value);
         }
         m_size = count;
+        maybe_shrink();
     }
 
     // vector::reserve actually does an enlarge-only resize as per the old API
@@ -1036,6 +1745,14 @@ public:
         }
     }
 
+    // Moves the elements into an exact-size immutable buffer and releases the storage of this one, which is left empty.
+    frozen_buffer<value_type, size_type> freeze() {
+        frozen_buffer<value_type, size_type> result(ptr(), size());
+        clear();
+        shrink_to_fit();
+        return result;
+    }
+
     reference operator[](size_type index) {
         SASSERT(index < size());
         return ptr()[index];
@@ -1083,16 +1800,16 @@ public:
     }
 
     void push_back(value_type const& value) {
-        if(size() >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size() >= capacity())) {
+            grow();
         }
         ::new(ptr() + size()) value_type(value);
         ++m_size;
     }
 
     void push_back(value_type&& value) {
-        if(size() >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size() >= capacity())) {
+            grow();
         }
         ::new(ptr() + size()) value_type(std::move(value));
         ++m_size;
@@ -1100,17 +1817,60 @@ public:
 
     template<typename... Args>
     void emplace_back(Args&&... args) {
-        if(size() >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size() >= capacity())) {
+            grow();
         }
         ::new(ptr() + size()) value_type(std::forward<Args>(args)...);
         ++m_size;
     }
 
+    // grows the capacity without changing the size, unlike reserve in the old vector interface
+    void ensure_capacity(size_type new_capacity) {
+        if(capacity() < new_capacity) {
+            reallocate(new_capacity);
+        }
+    }
+
+    // for loops that have called ensure_capacity up front
+    void push_back_unchecked(value_type const& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(value);
+        ++m_size;
+    }
+
+    void push_back_unchecked(value_type&& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(std::move(value));
+        ++m_size;
+    }
+
+    template<typename... Args>
+    void emplace_back_unchecked(Args&&... args) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(std::forward<Args>(args)...);
+        ++m_size;
+    }
+
+    // Returns `count` slots of spare capacity behind the last element, which the caller constructs in place and then
+    // publishes with `commit`. Growing again before committing discards the slots.
+    pointer grow_uninitialized(size_type count) {
+        if(NEW_BUFFER_UNLIKELY(capacity() - size() < count)) {
+            reallocate(std::max<size_type>(size() + count, next_capacity()));
+        }
+        return ptr() + size();
+    }
+
+    // publishes the first `count` slots returned by grow_uninitialized, which must have been constructed
+    void commit(size_type count) {
+        SASSERT(count <= capacity() - size());
+        m_size += count;
+    }
+
     void pop_back() {
         SASSERT(!empty()); 
-        end()->~value_type();
         --m_size;
+        end()->~value_type();
+        maybe_shrink();
     }
 
     iterator erase(const_iterator position) {
@@ -1153,11 +1913,13 @@ public:
         SASSERT(count <= size());
 		new_buffer_detail::destroy(ptr() + count, ptr() + size());
 		m_size = count;
+        maybe_shrink();
     }
     void set_end(iterator it) {
             auto const index = static_cast<size_type>(it - ptr());
 		new_buffer_detail::destroy(ptr() + index, ptr() + size());
 		m_size = index;
+        maybe_shrink();
     }
 
     // emplace_resize
@@ -1174,6 +1936,7 @@ public:
             }
             m_size = count;
         }
+        maybe_shrink();
     }
 
     pointer c_ptr() const noexcept { return m_data; } // breaks logical const-ness, prefer data() [which is disabled due to the data type]
@@ -1184,8 +1947,9 @@ public:
     }
 
     void append(unsigned n, T const * elems) {
-        for (unsigned i = 0; i < n; i++) {
-            push_back(elems[i]);
+        if(n > 0) { // the data of an empty buffer may be null, which memcpy must not see even for 0 bytes
+            new_buffer_detail::copy_into(grow_uninitialized(n), elems, n);
+            commit(n);
         }
     }
 
@@ -1193,6 +1957,10 @@ public:
         append(source.size(), source.ptr());
     }
 
+    void append(buffer_span<value_type const, size_type> source) {
+        append(source.size(), source.data());
+    }
+
     void reserve(size_type count) {
         if(count > size()) {
             resize(count);
@@ -1207,8 +1975,8 @@ public:
 };
 
 //----------------------------- vector that stores its size and capacity locally (allocator aware variant) -----------------------------//
-template<typename T, typename SZ>
-class new_buffer<T, SZ, -2> {
+template<typename T, typename SZ, typename SHRINK>
+class new_buffer<T, SZ, -2, SHRINK> {
     static_assert(std::numeric_limits<SZ>::is_integer, "SZ must be an unsigned integer type of reasonable size");
     static_assert(!std::numeric_limits<SZ>::is_signed, "SZ must be an unsigned integer type of reasonable size");
     static_assert(std::numeric_limits<SZ>::digits >= 8, "SZ must be an unsigned integer type of reasonable size");
@@ -1233,6 +2001,7 @@ private:
     pointer m_data = nullptr;
     size_type m_size = 0;
     size_type m_capacity = 0;
+    NEW_BUFFER_PROFILE(new_buffer_profile::tag<T> m_profile;)
 
     // ptr should really be public and called "data"
     pointer ptr() noexcept { return m_data; }
@@ -1243,10 +2012,27 @@ private:
         return cap == 0 ? 2 : (3 * cap + 1) / 2;
     }
 
+    // kept out of line, so that push_back only inlines the capacity check
+    NEW_BUFFER_COLD void grow() {
+        reallocate(next_capacity());
+    }
+
+    // applies the shrink policy after the size has gone down
+    void maybe_shrink() {
+        if(SHRINK::enabled) {
+            size_type const new_capacity = SHRINK::shrunk_capacity(size(), capacity());
+            if(NEW_BUFFER_UNLIKELY(new_capacity < capacity())) {
+                reallocate(new_capacity);
+            }
+        }
+    }
+
     template<typename U = value_type>
     typename std::enable_if<std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value && std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type const new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         SASSERT(new_capacity > 0);
         std::size_t const new_bytesize = static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         if(m_data == nullptr) { // memory::reallocate does not support realloc(0)
@@ -1258,12 +2044,15 @@ private:
             m_data = reinterpret_cast<pointer>(memory::reallocate(m_data, new_bytesize, actual_size));
             m_capacity = actual_size / sizeof(value_type);
         }
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), -2););
     }
 
     template<typename U = value_type>
     typename std::enable_if<!std::is_trivially_move_constructible<typename std::remove_cv<U>::type>::value || !std::is_trivially_destructible<typename std::remove_cv<U>::type>::value>::type
     reallocate(size_type new_capacity) {
         SASSERT(new_capacity >= size());
+        NEW_BUFFER_PROFILE(m_profile.on_reallocate(size(), capacity(), new_capacity););
+        NEW_BUFFER_USDT(size_type const old_capacity = capacity(); std::uintptr_t const old_address = reinterpret_cast<std::uintptr_t>(m_data);)
         SASSERT(new_capacity > 0);
         std::size_t const new_bytesize = static_cast<std::size_t>(new_capacity) * sizeof(value_type);
         std::size_t actual_size;
@@ -1276,6 +2065,7 @@ private:
         }
         m_data = new_data;
         m_capacity = new_capacity;
+        NEW_BUFFER_USDT(USDT_PROBE5(new_buffer, reallocate, old_capacity, capacity(), sizeof(value_type), new_buffer_detail::usdt_placement(old_capacity, old_address, m_data), -2););
     }
 
 public:
@@ -1292,17 +2082,35 @@ public:
 
     new_buffer& operator=(new_buffer const& other) {
         if(this != &other) {
-            clear();
-            auto const size = other.m_size;
-            if(size > 0) {
-                reallocate(size);
-                new_buffer_detail::copy_into(ptr(), other.ptr(), size);
-                m_size = size;
-            }
+            assign(other.begin(), other.end());
         }
         return *this;
     }
 
+    // [first, last) must not point into this buffer
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void assign(InputIt first, InputIt last) {
+        new_buffer_detail::assign(*this, first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+
+    void assign(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
+    new_buffer& operator=(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+        return *this;
+    }
+
+    template<typename InputIt, typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    new_buffer(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    new_buffer(std::initializer_list<value_type> elements) {
+        assign(elements.begin(), elements.end());
+    }
+
     new_buffer(new_buffer&& other) : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity) {
         other.m_data = nullptr;
         other.m_size = 0;
@@ -1325,6 +2133,7 @@ public:
     }
 
     ~new_buffer() {
+        NEW_BUFFER_PROFILE(m_profile.on_destroy(size()););
         if(m_data) { // TODO: find out if memory::deallocate supports free(NULL)
             new_buffer_detail::destroy(begin(), end());
             memory::deallocate(m_data, m_capacity * sizeof(value_type));
@@ -1332,6 +2141,33 @@ public:
         }
     }
 
+    // Takes ownership of `data`, which holds `size` constructed elements in a block of `capacity` elements that has been
+    // allocated with malloc or memory::allocate. The current contents are destroyed. The capacity is capped by the
+    // usable size of the block; the slack behind `capacity` is only picked up by the next reallocation.
+    void adopt(pointer data, size_type size, size_type capacity) {
+        SASSERT(size <= capacity);
+        SASSERT(data != nullptr || capacity == 0);
+        if(m_data) {
+            new_buffer_detail::destroy(begin(), end());
+            memory::deallocate(m_data, m_capacity * sizeof(value_type));
+        }
+        m_data = data;
+        m_size = size;
+        m_capacity = data ? std::min(capacity, static_cast<size_type>(memory::usable_size(data) / sizeof(value_type))) : 0;
+        memory::adopted(data, static_cast<std::size_t>(capacity) * sizeof(value_type));
+    }
+
+    // Gives up ownership of the block, which the caller frees with free or memory::deallocate(data, capacity() *
+    // sizeof(value_type)). Query size() and capacity() first, the buffer is left empty.
+    pointer release() noexcept {
+        pointer const data = m_data;
+        memory::released(data);
+        m_data = nullptr;
+        m_size = 0;
+        m_capacity = 0;
+        return data;
+    }
+
     // FIXME: src/muz/pdr/pdr_context.cpp relies on this constructor being implicit
     /* explicit */ new_buffer(size_type count) { resize(count); }
     new_buffer(size_type count, value_type const& element) { resize(count, element); }
@@ -1348,11 +2184,29 @@ public:
     size_type size() const noexcept { return m_size; }
     size_type capacity() const noexcept { return m_capacity; }
 
+    new_buffer_memory_usage memory_usage() const {
+        new_buffer_memory_usage result = new_buffer_detail::nested_memory_usage(ptr(), ptr() + size());
+        result.object_bytes = sizeof(*this);
+        if(m_data) {
+            std::size_t const heap_bytes = memory::usable_size(m_data);
+            result.heap_bytes += heap_bytes;
+            result.slack_bytes += heap_bytes - static_cast<std::size_t>(size()) * sizeof(value_type);
+        }
+        return result;
+    }
+
     void clear() noexcept {
         new_buffer_detail::destroy(ptr(), ptr() + size());
         m_size = 0;
     }
 
+    void shrink(size_type count) {
+        SASSERT(count <= size());
+        new_buffer_detail::destroy(ptr() + count, ptr() + size());
+        m_size = count;
+        maybe_shrink();
+    }
+
     void resize(size_type count) {
         _reserve(count);
         new_buffer_detail::destroy(ptr() + count, ptr() + size());
@@ -1360,6 +2214,7 @@ public:
             ::new(ptr() + i) value_type();
         }
         m_size = count;
+        maybe_shrink();
     }
 
     void resize(size_type count, value_type const& value) {
@@ -1369,6 +2224,7 @@ public:
             ::new(ptr() + i) value_type(value);
         }
         m_size = count;
+        maybe_shrink();
     }
 
     // vector::reserve actually does an enlarge-only resize as per the old API
@@ -1395,6 +2251,14 @@ public:
         }
     }
 
+    // Moves the elements into an exact-size immutable buffer and releases the storage of this one, which is left empty.
+    frozen_buffer<value_type, size_type> freeze() {
+        frozen_buffer<value_type, size_type> result(ptr(), size());
+        clear();
+        shrink_to_fit();
+        return result;
+    }
+
     reference operator[](size_type index) {
         SASSERT(index < size());
         return ptr()[index];
@@ -1442,16 +2306,16 @@ public:
     }
 
     void push_back(value_type const& value) {
-        if(size() >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size() >= capacity())) {
+            grow();
         }
         ::new(ptr() + size()) value_type(value);
         ++m_size;
     }
 
     void push_back(value_type&& value) {
-        if(size() >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size() >= capacity())) {
+            grow();
         }
         ::new(ptr() + size()) value_type(std::move(value));
         ++m_size;
@@ -1459,17 +2323,60 @@ public:
 
     template<typename... Args>
     void emplace_back(Args&&... args) {
-        if(size() >= capacity()) {
-            reallocate(next_capacity());
+        if(NEW_BUFFER_UNLIKELY(size() >= capacity())) {
+            grow();
         }
         ::new(ptr() + size()) value_type(std::forward<Args>(args)...);
         ++m_size;
     }
 
+    // grows the capacity without changing the size, unlike reserve in the old vector interface
+    void ensure_capacity(size_type new_capacity) {
+        if(capacity() < new_capacity) {
+            reallocate(new_capacity);
+        }
+    }
+
+    // for loops that have called ensure_capacity up front
+    void push_back_unchecked(value_type const& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(value);
+        ++m_size;
+    }
+
+    void push_back_unchecked(value_type&& value) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(std::move(value));
+        ++m_size;
+    }
+
+    template<typename... Args>
+    void emplace_back_unchecked(Args&&... args) {
+        SASSERT(size() < capacity());
+        ::new(ptr() + size()) value_type(std::forward<Args>(args)...);
+        ++m_size;
+    }
+
+    // Returns `count` slots of spare capacity behind the last element, which the caller constructs in place and then
+    // publishes with `commit`. Growing again before committing discards the slots.
+    pointer grow_uninitialized(size_type count) {
+        if(NEW_BUFFER_UNLIKELY(capacity() - size() < count)) {
+            reallocate(std::max<size_type>(size() + count, next_capacity()));
+        }
+        return ptr() + size();
+    }
+
+    // publishes the first `count` slots returned by grow_uninitialized, which must have been constructed
+    void commit(size_type count) {
+        SASSERT(count <= capacity() - size());
+        m_size += count;
+    }
+
     void pop_back() {
         SASSERT(!empty()); 
-        end()->~value_type();
         --m_size;
+        end()->~value_type();
+        maybe_shrink();
     }
 
     iterator erase(const_iterator position) {
@@ -1491,57 +2398,91 @@ public:
 
     // adaptors for the old vector interface
     pointer c_ptr() const { return m_data; }
-};
-
 
+    void append(unsigned n, T const * elems) {
+        if(n > 0) { // the data of an empty buffer may be null, which memcpy must not see even for 0 bytes
+            new_buffer_detail::copy_into(grow_uninitialized(n), elems, n);
+            commit(n);
+        }
+    }
 
-template<typename T1, typename SZ1, SZ1 INITIAL_SIZE1, typename T2, typename SZ2, SZ2 INITIAL_SIZE2>
-bool operator==(new_buffer<T1, SZ1, INITIAL_SIZE1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2> const& rhs) {
-    if(lhs.size() != rhs.size()) {
-        return false;
+    void append(const new_buffer& source) {
+        append(source.size(), source.ptr());
     }
-    auto li = lhs.cbegin();
-    auto lend = lhs.cend();
-    auto ri = rhs.cbegin();
-    for( ; li != lend; ++li, ++ri) {
-        if(*li != *ri) {
-            return false;
-        }
+
+    void append(buffer_span<value_type const, size_type> source) {
+        append(source.size(), source.data());
     }
-    SASSERT(ri == rhs.cend());
-    return true;
+};
+
+
+
+template<typename T1, typename SZ1, typename T2, typename SZ2>
+bool operator==(buffer_span<T1, SZ1> const& lhs, buffer_span<T2, SZ2> const& rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
 }
 
-template<typename T1, typename SZ1, SZ1 INITIAL_SIZE1, typename T2, typename SZ2, SZ2 INITIAL_SIZE2>
-bool operator!=(new_buffer<T1, SZ1, INITIAL_SIZE1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2> const& rhs) {
+template<typename T1, typename SZ1, typename T2, typename SZ2>
+bool operator!=(buffer_span<T1, SZ1> const& lhs, buffer_span<T2, SZ2> const& rhs) {
     return !(lhs == rhs);
 }
 
-template<typename T1, typename SZ1, SZ1 INITIAL_SIZE1, typename T2, typename SZ2, SZ2 INITIAL_SIZE2>
-bool operator< (new_buffer<T1, SZ1, INITIAL_SIZE1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2> const& rhs) {
-    return std::lexicographical_compare(lhs.cbegin(), lhs.cend(), rhs.cbegin(), rhs.cend(), [](T1 const& lhs, T2 const& rhs) -> bool { return lhs < rhs; });
+template<typename T1, typename SZ1, typename T2, typename SZ2>
+bool operator< (buffer_span<T1, SZ1> const& lhs, buffer_span<T2, SZ2> const& rhs) {
+    return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](T1 const& lhs, T2 const& rhs) -> bool { return lhs < rhs; });
+}
+
+template<typename T1, typename SZ1, typename T2, typename SZ2>
+bool operator<=(buffer_span<T1, SZ1> const& lhs, buffer_span<T2, SZ2> const& rhs) {
+    return !(rhs < lhs);
+}
+
+template<typename T1, typename SZ1, typename T2, typename SZ2>
+bool operator> (buffer_span<T1, SZ1> const& lhs, buffer_span<T2, SZ2> const& rhs) {
+    return rhs < lhs;
 }
 
-template<typename T1, typename SZ1, SZ1 INITIAL_SIZE1, typename T2, typename SZ2, SZ2 INITIAL_SIZE2>
-bool operator<=(new_buffer<T1, SZ1, INITIAL_SIZE1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2> const& rhs) {
-    return std::lexicographical_compare(lhs.cbegin(), lhs.cend(), rhs.cbegin(), rhs.cend(), [](T1 const& lhs, T2 const& rhs) -> bool { return lhs <= rhs; });
+template<typename T1, typename SZ1, typename T2, typename SZ2>
+bool operator>=(buffer_span<T1, SZ1> const& lhs, buffer_span<T2, SZ2> const& rhs) {
+    return !(lhs < rhs);
 }
 
-template<typename T1, typename SZ1, SZ1 INITIAL_SIZE1, typename T2, typename SZ2, SZ2 INITIAL_SIZE2>
-bool operator> (new_buffer<T1, SZ1, INITIAL_SIZE1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2> const& rhs) {
-    return std::lexicographical_compare(lhs.cbegin(), lhs.cend(), rhs.cbegin(), rhs.cend(), [](T1 const& lhs, T2 const& rhs) -> bool { return lhs > rhs; });
+template<typename T1, typename SZ1, std::size_t INITIAL_SIZE1, typename SHRINK1, typename T2, typename SZ2, std::size_t INITIAL_SIZE2, typename SHRINK2>
+bool operator==(new_buffer<T1, SZ1, INITIAL_SIZE1, SHRINK1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2, SHRINK2> const& rhs) {
+    return buffer_span<T1 const, SZ1>(lhs) == buffer_span<T2 const, SZ2>(rhs);
 }
 
-template<typename T1, typename SZ1, SZ1 INITIAL_SIZE1, typename T2, typename SZ2, SZ2 INITIAL_SIZE2>
-bool operator>=(new_buffer<T1, SZ1, INITIAL_SIZE1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2> const& rhs) {
-    return std::lexicographical_compare(lhs.cbegin(), lhs.cend(), rhs.cbegin(), rhs.cend(), [](T1 const& lhs, T2 const& rhs) -> bool { return lhs >= rhs; });
+template<typename T1, typename SZ1, std::size_t INITIAL_SIZE1, typename SHRINK1, typename T2, typename SZ2, std::size_t INITIAL_SIZE2, typename SHRINK2>
+bool operator!=(new_buffer<T1, SZ1, INITIAL_SIZE1, SHRINK1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2, SHRINK2> const& rhs) {
+    return buffer_span<T1 const, SZ1>(lhs) != buffer_span<T2 const, SZ2>(rhs);
+}
+
+template<typename T1, typename SZ1, std::size_t INITIAL_SIZE1, typename SHRINK1, typename T2, typename SZ2, std::size_t INITIAL_SIZE2, typename SHRINK2>
+bool operator< (new_buffer<T1, SZ1, INITIAL_SIZE1, SHRINK1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2, SHRINK2> const& rhs) {
+    return buffer_span<T1 const, SZ1>(lhs) < buffer_span<T2 const, SZ2>(rhs);
+}
+
+template<typename T1, typename SZ1, std::size_t INITIAL_SIZE1, typename SHRINK1, typename T2, typename SZ2, std::size_t INITIAL_SIZE2, typename SHRINK2>
+bool operator<=(new_buffer<T1, SZ1, INITIAL_SIZE1, SHRINK1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2, SHRINK2> const& rhs) {
+    return buffer_span<T1 const, SZ1>(lhs) <= buffer_span<T2 const, SZ2>(rhs);
+}
+
+template<typename T1, typename SZ1, std::size_t INITIAL_SIZE1, typename SHRINK1, typename T2, typename SZ2, std::size_t INITIAL_SIZE2, typename SHRINK2>
+bool operator> (new_buffer<T1, SZ1, INITIAL_SIZE1, SHRINK1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2, SHRINK2> const& rhs) {
+    return buffer_span<T1 const, SZ1>(lhs) > buffer_span<T2 const, SZ2>(rhs);
+}
+
+template<typename T1, typename SZ1, std::size_t INITIAL_SIZE1, typename SHRINK1, typename T2, typename SZ2, std::size_t INITIAL_SIZE2, typename SHRINK2>
+bool operator>=(new_buffer<T1, SZ1, INITIAL_SIZE1, SHRINK1> const& lhs, new_buffer<T2, SZ2, INITIAL_SIZE2, SHRINK2> const& rhs) {
+    return buffer_span<T1 const, SZ1>(lhs) >= buffer_span<T2 const, SZ2>(rhs);
 }
 
 namespace std {
-    template<typename T, typename SZ, std::size_t INITIAL_SIZE>
-    struct hash<::new_buffer<T, SZ, INITIAL_SIZE>> {
+    // equal spans and buffers hash equally
+    template<typename T, typename SZ>
+    struct hash<::buffer_span<T, SZ>> {
         // investigate `get_composite_hash`
-        using argument_type = ::new_buffer<T, SZ, INITIAL_SIZE>;
+        using argument_type = ::buffer_span<T, SZ>;
         using result_type = ::std::size_t;
         result_type operator()(argument_type const& value) const {
             result_type result = ::std::hash<typename argument_type::size_type>()(value.size());
@@ -1554,6 +2495,15 @@ namespace std {
             return result;
         }
     };
+
+    template<typename T, typename SZ, std::size_t INITIAL_SIZE, typename SHRINK>
+    struct hash<::new_buffer<T, SZ, INITIAL_SIZE, SHRINK>> {
+        using argument_type = ::new_buffer<T, SZ, INITIAL_SIZE, SHRINK>;
+        using result_type = ::std::size_t;
+        result_type operator()(argument_type const& value) const {
+            return ::std::hash<::buffer_span<T const, SZ>>()(value);
+        }
+    };
 }
 
 #endif /* NEW_BUFFER_H_ */
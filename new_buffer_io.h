@@ -0,0 +1,26 @@
+#ifndef NEW_BUFFER_IO_H_
+#define NEW_BUFFER_IO_H_
+
+// POSIX I/O straight into the spare capacity of a new_buffer, built on grow_uninitialized and commit, so that the
+// container itself stays free of platform headers.
+
+#include "new_buffer.h"
+
+#include <type_traits>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+// Reads up to `max_bytes` from `fd` into the spare capacity of a buffer of bytes and returns the result of read(2).
+// Works for every new_buffer specialization.
+template<typename Buffer>
+typename std::enable_if<sizeof(typename Buffer::value_type) == 1 && std::is_trivial<typename Buffer::value_type>::value, ssize_t>::type
+read_into(Buffer& buffer, int fd, typename Buffer::size_type max_bytes) {
+    ssize_t const result = ::read(fd, buffer.grow_uninitialized(max_bytes), max_bytes);
+    if(result > 0) {
+        buffer.commit(static_cast<typename Buffer::size_type>(result));
+    }
+    return result;
+}
+
+#endif /* NEW_BUFFER_IO_H_ */
@@ -0,0 +1,275 @@
+#ifndef NEW_BUFFER_PROFILE_H_
+#define NEW_BUFFER_PROFILE_H_
+
+// Size-distribution profiler for new_buffer, enabled by compiling with -DPROFILE_BUFFERS=1.
+//
+// Every buffer is tagged with its construction site and element type. Per site, the profiler records histograms of the
+// final size, peak size, number of growths and lifetime of its buffers, as well as the capacity requested by every
+// growth. At exit, it writes a report to $NEW_BUFFER_PROFILE_FILE (default: stderr) that ranks the sites by the number
+// of allocations an inline buffer of $NEW_BUFFER_PROFILE_K elements (default: 16) would have saved, together with a
+// table of the allocations and bytes saved and the object bytes added for every power of two up to 1024.
+//
+// The construction site is the return address of the (never inlined) tag constructor, i.e., the function that the
+// new_buffer constructor has been inlined into. Build with optimizations so that this is the user of the buffer, and
+// with -rdynamic so that the sites can be symbolized; otherwise, use `addr2line -f -C -e <binary> <offset>`.
+// Peak sizes are observed at reallocations and at destruction only.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+namespace new_buffer_profile {
+    // bin 0 holds 0, bin b > 0 holds (2^(b-2), 2^(b-1)], so that "at most 2^k" are exactly the bins 0..k+1
+    static constexpr std::size_t bins = 66;
+
+    inline std::size_t bin(std::uint64_t value) noexcept {
+        if(value <= 1) {
+            return static_cast<std::size_t>(value);
+        }
+        return 2 + static_cast<std::size_t>(63 - __builtin_clzll(value - 1));
+    }
+
+    inline std::uint64_t bin_upper_bound(std::size_t bin) noexcept {
+        return bin == 0 ? 0 : static_cast<std::uint64_t>(1) << (bin - 1);
+    }
+
+    struct histogram {
+        std::atomic<std::uint64_t> counts[bins];
+
+        histogram() noexcept {
+            for(auto& count : counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void add(std::uint64_t value) noexcept { counts[bin(value)].fetch_add(1, std::memory_order_relaxed); }
+
+        std::uint64_t total() const noexcept {
+            std::uint64_t result = 0;
+            for(auto const& count : counts) {
+                result += count.load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+        // upper bound of the bin that contains the given quantile
+        std::uint64_t quantile(double q) const noexcept {
+            std::uint64_t const n = total();
+            std::uint64_t seen = 0;
+            for(std::size_t i = 0; i < bins; ++i) {
+                seen += counts[i].load(std::memory_order_relaxed);
+                if(n > 0 && static_cast<double>(seen) >= q * static_cast<double>(n)) {
+                    return bin_upper_bound(i);
+                }
+            }
+            return 0;
+        }
+    };
+
+    struct site_stats {
+        std::size_t element_size;
+        std::atomic<std::uint64_t> buffers{0};
+        histogram final_size;
+        histogram peak_size;
+        histogram growths;
+        histogram lifetime_ns;
+        // every growth by the capacity it requested, as counts and bytes
+        histogram growth_capacity;
+        std::atomic<std::uint64_t> growth_bytes[bins];
+
+        explicit site_stats(std::size_t element_size) noexcept : element_size(element_size) {
+            for(auto& bytes : growth_bytes) {
+                bytes.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct site_key {
+        void const* address;
+        char const* type; // mangled, from std::type_info::name
+        bool operator==(site_key const& other) const noexcept { return address == other.address && type == other.type; }
+    };
+
+    struct site_key_hash {
+        std::size_t operator()(site_key const& key) const noexcept {
+            return std::hash<void const*>()(key.address) * 31 + std::hash<void const*>()(key.type);
+        }
+    };
+
+    inline std::uint64_t now_ns() noexcept {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    class registry {
+        std::mutex m_mutex;
+        // nodes are never erased, so site_stats pointers stay valid
+        std::unordered_map<site_key, site_stats, site_key_hash> m_sites;
+
+        registry() {
+            std::atexit([]() { instance().report(); });
+        }
+
+        static std::string symbolize(void const* address) {
+            char text[64];
+            Dl_info info;
+            if(dladdr(address, &info) && info.dli_fname) {
+                std::string result;
+                if(info.dli_sname) {
+                    int status = 0;
+                    char* const demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                    result = status == 0 ? demangled : info.dli_sname;
+                    std::free(demangled);
+                    std::snprintf(text, sizeof(text), "+0x%zx ", static_cast<std::size_t>(static_cast<char const*>(address) - static_cast<char const*>(info.dli_saddr)));
+                    result += text;
+                }
+                std::snprintf(text, sizeof(text), "(+0x%zx)", static_cast<std::size_t>(static_cast<char const*>(address) - static_cast<char const*>(info.dli_fbase)));
+                return result + info.dli_fname + text;
+            }
+            std::snprintf(text, sizeof(text), "%p", address);
+            return text;
+        }
+
+        static std::string demangle(char const* type) {
+            int status = 0;
+            char* const demangled = abi::__cxa_demangle(type, nullptr, nullptr, &status);
+            std::string result = status == 0 ? demangled : type;
+            std::free(demangled);
+            return result;
+        }
+
+    public:
+        // never destroyed, so that buffers with static storage duration can still be profiled during shutdown
+        static registry& instance() {
+            static registry* const result = new registry();
+            return *result;
+        }
+
+        site_stats* lookup(void const* address, std::type_info const& type, std::size_t element_size) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            site_key const key = { address, type.name() };
+            auto it = m_sites.find(key);
+            if(it == m_sites.end()) {
+                it = m_sites.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(element_size)).first;
+            }
+            return &it->second;
+        }
+
+        void report() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            char const* const path = std::getenv("NEW_BUFFER_PROFILE_FILE");
+            std::FILE* const file = path ? std::fopen(path, "w") : stderr;
+            if(!file) {
+                return;
+            }
+            char const* const k_text = std::getenv("NEW_BUFFER_PROFILE_K");
+            std::uint64_t const k = k_text ? std::strtoull(k_text, nullptr, 10) : 16;
+
+            // allocations that an inline buffer of `inline_size` elements would have avoided
+            auto const saved = [](site_stats const& stats, std::uint64_t inline_size, std::uint64_t& bytes) -> std::uint64_t {
+                std::uint64_t allocations = 0;
+                bytes = 0;
+                for(std::size_t i = 0; i < bins && bin_upper_bound(i) <= inline_size; ++i) {
+                    allocations += stats.growth_capacity.counts[i].load(std::memory_order_relaxed);
+                    bytes += stats.growth_bytes[i].load(std::memory_order_relaxed);
+                }
+                return allocations;
+            };
+
+            std::vector<std::pair<site_key const*, site_stats const*>> sites;
+            for(auto const& site : m_sites) {
+                sites.emplace_back(&site.first, &site.second);
+            }
+            std::sort(sites.begin(), sites.end(), [&](std::pair<site_key const*, site_stats const*> const& lhs, std::pair<site_key const*, site_stats const*> const& rhs) {
+                std::uint64_t bytes;
+                return saved(*lhs.second, k, bytes) > saved(*rhs.second, k, bytes);
+            });
+
+            std::fprintf(file, "new_buffer profile: %zu sites, ranked by allocations saved with %llu inline elements\n", sites.size(), static_cast<unsigned long long>(k));
+            for(auto const& site : sites) {
+                site_stats const& stats = *site.second;
+                std::uint64_t const buffers = stats.buffers.load(std::memory_order_relaxed);
+                std::fprintf(file, "\n%s\n  element type %s (%zu bytes), %llu buffers, %llu growths\n",
+                    symbolize(site.first->address).c_str(), demangle(site.first->type).c_str(), stats.element_size,
+                    static_cast<unsigned long long>(buffers), static_cast<unsigned long long>(stats.growth_capacity.total()));
+                std::fprintf(file, "  %-10s %10s %10s %10s %10s\n", "", "p50", "p90", "p99", "max");
+                histogram const* const histograms[] = { &stats.final_size, &stats.peak_size, &stats.growths, &stats.lifetime_ns };
+                char const* const names[] = { "final size", "peak size", "growths", "lifetime" };
+                for(std::size_t i = 0; i < 4; ++i) {
+                    std::fprintf(file, "  %-10s %10llu %10llu %10llu %10llu\n", names[i],
+                        static_cast<unsigned long long>(histograms[i]->quantile(0.5)), static_cast<unsigned long long>(histograms[i]->quantile(0.9)),
+                        static_cast<unsigned long long>(histograms[i]->quantile(0.99)), static_cast<unsigned long long>(histograms[i]->quantile(1)));
+                }
+                std::fprintf(file, "  %-10s %14s %14s %14s\n", "inline", "saved allocs", "saved bytes", "added bytes");
+                for(std::uint64_t inline_size = 1; inline_size <= 1024; inline_size *= 2) {
+                    std::uint64_t bytes;
+                    std::uint64_t const allocations = saved(stats, inline_size, bytes);
+                    std::fprintf(file, "  %-10llu %14llu %14llu %14llu\n", static_cast<unsigned long long>(inline_size),
+                        static_cast<unsigned long long>(allocations), static_cast<unsigned long long>(bytes),
+                        static_cast<unsigned long long>(buffers * inline_size * stats.element_size));
+                }
+            }
+            if(file != stderr) {
+                std::fclose(file);
+            }
+        }
+    };
+
+    // Member of every new_buffer in profiling builds. Copies and moves are new buffers with their own construction site.
+    template<typename T>
+    class tag {
+        site_stats* m_stats = nullptr;
+        std::uint64_t m_birth = 0;
+        std::uint64_t m_peak = 0;
+        std::uint64_t m_growths = 0;
+
+        __attribute__((noinline)) void construct(void const* site) noexcept {
+            try {
+                m_stats = registry::instance().lookup(site, typeid(T), sizeof(T));
+                m_stats->buffers.fetch_add(1, std::memory_order_relaxed);
+                m_birth = now_ns();
+            } catch(...) {
+                m_stats = nullptr; // profiling is best-effort
+            }
+        }
+
+    public:
+        __attribute__((noinline)) tag() noexcept { construct(__builtin_return_address(0)); }
+        __attribute__((noinline)) tag(tag const&) noexcept { construct(__builtin_return_address(0)); }
+        tag& operator=(tag const&) noexcept { return *this; }
+
+        void on_reallocate(std::uint64_t size, std::uint64_t old_capacity, std::uint64_t new_capacity) noexcept {
+            m_peak = std::max(m_peak, size);
+            if(m_stats && new_capacity > old_capacity) {
+                ++m_growths;
+                m_stats->growth_capacity.add(new_capacity);
+                m_stats->growth_bytes[bin(new_capacity)].fetch_add(new_capacity * sizeof(T), std::memory_order_relaxed);
+            }
+        }
+
+        void on_destroy(std::uint64_t size) noexcept {
+            if(m_stats) {
+                m_stats->final_size.add(size);
+                m_stats->peak_size.add(std::max(m_peak, size));
+                m_stats->growths.add(m_growths);
+                m_stats->lifetime_ns.add(now_ns() - m_birth);
+            }
+        }
+    };
+}
+
+#endif /* NEW_BUFFER_PROFILE_H_ */
@@ -0,0 +1,153 @@
+#ifndef NEW_BUFFER_USAGE_H_
+#define NEW_BUFFER_USAGE_H_
+
+// Aggregates the memory_usage of new_buffers by element type, to attribute the memory of a process to its data
+// structures. Buffers are not tracked; instead, the owner of a data structure adds its buffers whenever a report is
+// wanted, e.g.:
+//
+//     new_buffer_usage_registry registry;
+//     registry.add(clauses.begin(), clauses.end());
+//     registry.report(stderr);
+//
+// Nested buffers are attributed to their own element type: the heap and slack bytes of a buffer of buffers are split
+// between the outer and the inner element type, and the inner buffers are counted as buffers with object bytes of 0.
+
+#include "new_buffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+
+class new_buffer_usage_registry {
+public:
+    struct entry {
+        std::string type; // demangled element type
+        std::size_t element_size = 0;
+        std::uint64_t buffers = 0;
+        std::uint64_t elements = 0;
+        new_buffer_memory_usage usage;
+
+        // bytes taken by the elements themselves
+        std::uint64_t payload_bytes() const noexcept { return elements * element_size; }
+    };
+
+private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::type_index, entry> m_entries; // by element type
+
+    static std::string demangle(char const* type) {
+        int status = 0;
+        char* const demangled = abi::__cxa_demangle(type, nullptr, nullptr, &status);
+        std::string result = status == 0 ? demangled : type;
+        std::free(demangled);
+        return result;
+    }
+
+    void record(std::type_info const& type, std::size_t element_size, std::uint64_t buffers, std::uint64_t elements, new_buffer_memory_usage const& usage) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(std::type_index(type));
+        if(it == m_entries.end()) {
+            it = m_entries.emplace(std::type_index(type), entry()).first;
+            it->second.type = demangle(type.name());
+            it->second.element_size = element_size;
+        }
+        it->second.buffers += buffers;
+        it->second.elements += elements;
+        it->second.usage += usage;
+    }
+
+    template<typename T>
+    auto add_nested(T const* begin, T const* end, int) -> decltype(begin->memory_usage(), void()) {
+        for(; begin < end; ++begin) {
+            add(*begin, false);
+        }
+    }
+
+    template<typename T>
+    void add_nested(T const* /*begin*/, T const* /*end*/, long) noexcept { }
+
+    // `outermost` buffers own their object bytes, nested ones live in the elements of their parent
+    template<typename Buffer>
+    void add(Buffer const& buffer, bool outermost) {
+        using value_type = typename Buffer::value_type;
+        value_type const* const begin = buffer.begin();
+        value_type const* const end = begin + buffer.size();
+        new_buffer_memory_usage usage = buffer.memory_usage();
+        new_buffer_memory_usage const nested = new_buffer_detail::nested_memory_usage(begin, end);
+        usage.heap_bytes -= nested.heap_bytes;
+        usage.slack_bytes -= nested.slack_bytes;
+        if(!outermost) {
+            usage.object_bytes = 0;
+        }
+        record(typeid(value_type), sizeof(value_type), 1, buffer.size(), usage);
+        add_nested(begin, end, 0);
+    }
+
+public:
+    // never destroyed, so that buffers with static storage duration can still be added during shutdown
+    static new_buffer_usage_registry& instance() {
+        static new_buffer_usage_registry* const result = new new_buffer_usage_registry();
+        return *result;
+    }
+
+    // works for every new_buffer specialization and frozen_buffer
+    template<typename Buffer>
+    void add(Buffer const& buffer) { add(buffer, true); }
+
+    template<typename InputIt>
+    void add(InputIt first, InputIt last) {
+        for(; first != last; ++first) {
+            add(*first, true);
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+    }
+
+    // ordered by total bytes, largest first
+    std::vector<entry> entries() const {
+        std::vector<entry> result;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for(auto const& it : m_entries) {
+                result.push_back(it.second);
+            }
+        }
+        std::sort(result.begin(), result.end(), [](entry const& lhs, entry const& rhs) { return lhs.usage.total_bytes() > rhs.usage.total_bytes(); });
+        return result;
+    }
+
+    new_buffer_memory_usage total() const {
+        new_buffer_memory_usage result;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(auto const& it : m_entries) {
+            result += it.second.usage;
+        }
+        return result;
+    }
+
+    void report(std::FILE* file) const {
+        std::vector<entry> const all = entries();
+        std::fprintf(file, "new_buffer memory usage by element type\n");
+        std::fprintf(file, "%14s %14s %14s %14s %14s %14s  %s\n", "buffers", "elements", "payload", "object", "heap", "slack", "element type");
+        for(auto const& it : all) {
+            std::fprintf(file, "%14llu %14llu %14llu %14zu %14zu %14zu  %s (%zu bytes)\n",
+                static_cast<unsigned long long>(it.buffers), static_cast<unsigned long long>(it.elements), static_cast<unsigned long long>(it.payload_bytes()),
+                it.usage.object_bytes, it.usage.heap_bytes, it.usage.slack_bytes, it.type.c_str(), it.element_size);
+        }
+    }
+};
+
+#endif /* NEW_BUFFER_USAGE_H_ */
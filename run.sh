@@ -8,14 +8,29 @@ CXX=${CXX:-c++}
 ALLOCATOR=${ALLOCATOR:-}
 # ALLOCATOR="-DTCMALLOC=1 -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free -ltcmalloc"
 # ALLOCATOR="-DJEMALLOC=1 -fno-builtin-malloc -fno-builtin-calloc -fno-builtin-realloc -fno-builtin-free -I$(jemalloc-config --includedir) -L$(jemalloc-config --libdir) -Wl,-rpath,$(jemalloc-config --libdir)/lib -ljemalloc"
-# ALLOCATOR="$ALLOCATOR -DMEASURE_MEMORY=1"
+# ALLOCATOR="$ALLOCATOR -DMEASURE_MEMORY=0" # memory is measured in untimed replays, which only costs setup time
+# ALLOCATOR="$ALLOCATOR -DMEASURE_PERF=1" # hardware counters, requires perf_event_paranoid <= 2
+# ALLOCATOR="$ALLOCATOR -DMEASURE_HUGEPAGES=1" # transparent huge pages from /proc/self/smaps_rollup
+# ALLOCATOR="$ALLOCATOR -DMEMORY_ACCOUNTING=1" # per-thread batched byte counters with soft/hard limits, see util/memory_accounting.h
+# ALLOCATOR="$ALLOCATOR -DSAMPLE_ALLOCATIONS=1 -rdynamic" # sampled heap profile written to $MEMORY_PROFILE_FILE at exit, see util/memory_sampler.h
+# ALLOCATOR="$ALLOCATOR -DUSDT_PROBES=0" # removes the tracepoints for tools/usdt_trace.sh, which are compiled in whenever <sys/sdt.h> is available
+# ALLOCATOR="$ALLOCATOR -DTRACE_ALLOCATIONS=1" # writes $MEMORY_TRACE_FILE for tools/alloc_replay.cpp, best combined with --benchmark_filter
+# ALLOCATOR="$ALLOCATOR -DPROFILE_BUFFERS=1 -rdynamic" # per-site size distributions of new_buffer, reported at exit to $NEW_BUFFER_PROFILE_FILE
+
+SOURCES=${SOURCES:-main.cpp}
+# allocator-independent counters (mallocs, reallocs, peak_bytes, ...) by linking the interposing allocation tracker
+# SOURCES="$SOURCES bench/alloc_tracker.cpp -ldl"
+# ... or by preloading it into an unmodified benchmark binary
+# $CXX -std=c++11 -O2 -fPIC -shared bench/alloc_tracker.cpp -o alloc_tracker.so -ldl && export LD_PRELOAD="$PWD/alloc_tracker.so"
 
 OPT=${OPT:--O3 -flto}
 OPT="$OPT -DNDEBUG"
 # OPT="-Og -g -fsanitize=address,undefined"
 
-echo "Using \$CXX='${CXX}' with \$OPT='${OPT}' and \$ALLOCATOR='${ALLOCATOR}'"
+echo "Using \$CXX='${CXX}' with \$OPT='${OPT}' and \$ALLOCATOR='${ALLOCATOR}' for \$SOURCES='${SOURCES}'"
 
-$CXX -std=c++11 $OPT -lbenchmark $ALLOCATOR -pthread main.cpp
+$CXX -std=c++11 $OPT -lbenchmark $ALLOCATOR -pthread $SOURCES
 
+# CACHE_MODE=flushed or CACHE_MODE=thrashed starts the iterations of the copy, random access and subrange benchmarks
+# with cold caches, see bench/cache_state.h
 ./a.out --benchmark_counters_tabular=true --benchmark_out=result."$(date +%s)".json --benchmark_out_format=json --benchmark_repetitions=6
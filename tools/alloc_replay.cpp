@@ -0,0 +1,237 @@
+// Replays an allocation trace recorded with -DTRACE_ALLOCATIONS=1 (see util/memory_trace.h).
+//
+//   c++ -std=c++11 -O2 tools/alloc_replay.cpp -o alloc_replay
+//   ./alloc_replay [--model=malloc|size-classes] memory.trace
+//
+// The malloc model re-executes the trace against the allocator the tool is linked with; link it with -ljemalloc or
+// -ltcmalloc (or LD_PRELOAD them) to compare allocators. The size-classes model simulates an allocator with jemalloc's
+// size classes that reallocates in place only within a size class. Without --model, all models are run.
+//
+// Records are replayed in trace order on a single thread; the memory that is handed out is never touched.
+
+#include "../util/memory_trace.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+
+namespace {
+	class replay_model {
+	public:
+		virtual ~replay_model() {}
+		virtual char const* name() const = 0;
+		virtual void allocate(std::uint64_t id, std::size_t size) = 0;
+		virtual void reallocate(std::uint64_t id, std::size_t size) = 0;
+		virtual void deallocate(std::uint64_t id) = 0;
+		// bytes the allocator has set aside for the live allocations, including size class rounding
+		virtual std::size_t held_bytes() const = 0;
+		virtual std::uint64_t moves() const = 0;
+	};
+
+	class malloc_model final : public replay_model {
+		std::vector<void*> m_blocks;
+		std::size_t m_held = 0;
+		std::uint64_t m_moves = 0;
+
+	public:
+		~malloc_model() {
+			for(void* block : m_blocks) {
+				free(block);
+			}
+		}
+
+		char const* name() const override { return "malloc"; }
+
+		void allocate(std::uint64_t id, std::size_t size) override {
+			if(id >= m_blocks.size()) {
+				m_blocks.resize(id + 1, nullptr);
+			}
+			m_blocks[id] = malloc(size);
+			m_held += malloc_usable_size(m_blocks[id]);
+		}
+
+		void reallocate(std::uint64_t id, std::size_t size) override {
+			void* const old_block = m_blocks[id];
+			m_held -= malloc_usable_size(old_block);
+			m_blocks[id] = realloc(old_block, size);
+			m_held += malloc_usable_size(m_blocks[id]);
+			if(m_blocks[id] != old_block) {
+				++m_moves;
+			}
+		}
+
+		void deallocate(std::uint64_t id) override {
+			m_held -= malloc_usable_size(m_blocks[id]);
+			free(m_blocks[id]);
+			m_blocks[id] = nullptr;
+		}
+
+		std::size_t held_bytes() const override { return m_held; }
+		std::uint64_t moves() const override { return m_moves; }
+	};
+
+	class size_class_model final : public replay_model {
+		std::vector<std::size_t> m_classes;
+		std::size_t m_held = 0;
+		std::uint64_t m_moves = 0;
+
+		// 16 byte spacing up to 128 bytes, then four classes per doubling
+		static std::size_t size_class(std::size_t size) {
+			if(size <= 8) {
+				return 8;
+			}
+			if(size <= 128) {
+				return (size + 15) & ~static_cast<std::size_t>(15);
+			}
+			unsigned const log2 = 63 - static_cast<unsigned>(__builtin_clzll(static_cast<unsigned long long>(size - 1)));
+			std::size_t const spacing = static_cast<std::size_t>(1) << (log2 - 2);
+			return (size + spacing - 1) & ~(spacing - 1);
+		}
+
+	public:
+		char const* name() const override { return "size-classes"; }
+
+		void allocate(std::uint64_t id, std::size_t size) override {
+			if(id >= m_classes.size()) {
+				m_classes.resize(id + 1, 0);
+			}
+			m_classes[id] = size_class(size);
+			m_held += m_classes[id];
+		}
+
+		void reallocate(std::uint64_t id, std::size_t size) override {
+			std::size_t const new_class = size_class(size);
+			if(new_class != m_classes[id]) {
+				++m_moves;
+				m_held = m_held - m_classes[id] + new_class;
+				m_classes[id] = new_class;
+			}
+		}
+
+		void deallocate(std::uint64_t id) override {
+			m_held -= m_classes[id];
+			m_classes[id] = 0;
+		}
+
+		std::size_t held_bytes() const override { return m_held; }
+		std::uint64_t moves() const override { return m_moves; }
+	};
+
+	bool read_trace(char const* path, std::vector<memory_trace_record>& records) {
+		std::FILE* const file = std::fopen(path, "rb");
+		if(!file) {
+			std::fprintf(stderr, "%s: cannot open\n", path);
+			return false;
+		}
+		char magic[sizeof(memory_trace_magic)];
+		std::uint32_t header[2];
+		if(std::fread(magic, sizeof(magic), 1, file) != 1 || std::memcmp(magic, memory_trace_magic, sizeof(magic)) != 0
+			|| std::fread(header, sizeof(header), 1, file) != 1 || header[0] != memory_trace_version || header[1] != sizeof(memory_trace_record)) {
+			std::fprintf(stderr, "%s: not a memory trace of version %u\n", path, static_cast<unsigned>(memory_trace_version));
+			std::fclose(file);
+			return false;
+		}
+		memory_trace_record record;
+		while(std::fread(&record, sizeof(record), 1, file) == 1) {
+			records.push_back(record);
+		}
+		std::fclose(file);
+		return true;
+	}
+
+	void replay(std::vector<memory_trace_record> const& records, replay_model& model) {
+		std::vector<std::size_t> requested; // by id
+		std::size_t live = 0;
+		std::size_t peak_live = 0;
+		std::size_t peak_held = 0;
+		std::uint64_t skipped = 0;
+
+		auto const start = std::chrono::steady_clock::now();
+		for(auto const& record : records) {
+			switch(record.op) {
+			case memory_trace_op::allocate:
+				if(record.id >= requested.size()) {
+					requested.resize(record.id + 1, 0);
+				}
+				model.allocate(record.id, record.size);
+				requested[record.id] = record.size;
+				live += record.size;
+				break;
+			case memory_trace_op::reallocate:
+				model.reallocate(record.id, record.size);
+				live = live - requested[record.id] + record.size;
+				requested[record.id] = record.size;
+				break;
+			case memory_trace_op::deallocate:
+				model.deallocate(record.id);
+				live -= requested[record.id];
+				requested[record.id] = 0;
+				break;
+			default:
+				++skipped;
+				continue;
+			}
+			if(live > peak_live) {
+				peak_live = live;
+			}
+			if(model.held_bytes() > peak_held) {
+				peak_held = model.held_bytes();
+			}
+		}
+		auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		std::printf("%-14s %12zu %12zu %8.4f %10llu %12.2f\n", model.name(), peak_live, peak_held,
+			peak_live ? static_cast<double>(peak_held) / static_cast<double>(peak_live) : 0.0,
+			static_cast<unsigned long long>(model.moves()), records.empty() ? 0.0 : static_cast<double>(elapsed) / static_cast<double>(records.size()));
+		if(skipped) {
+			std::fprintf(stderr, "skipped %llu records with unknown operations\n", static_cast<unsigned long long>(skipped));
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	std::string model_name;
+	char const* path = nullptr;
+	for(int i = 1; i < argc; ++i) {
+		if(std::strncmp(argv[i], "--model=", 8) == 0) {
+			model_name = argv[i] + 8;
+		} else {
+			path = argv[i];
+		}
+	}
+	if(path == nullptr) {
+		std::fprintf(stderr, "usage: %s [--model=malloc|size-classes] memory.trace\n", argv[0]);
+		return 1;
+	}
+	std::vector<memory_trace_record> records;
+	if(!read_trace(path, records)) {
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<replay_model>> models;
+	if(model_name.empty() || model_name == "malloc") {
+		models.emplace_back(new malloc_model());
+	}
+	if(model_name.empty() || model_name == "size-classes") {
+		models.emplace_back(new size_class_model());
+	}
+	if(models.empty()) {
+		std::fprintf(stderr, "unknown model '%s'\n", model_name.c_str());
+		return 1;
+	}
+
+	std::printf("%zu records\n", records.size());
+	std::printf("%-14s %12s %12s %8s %10s %12s\n", "model", "peak_live", "peak_held", "frag", "moves", "ns/op");
+	for(auto& model : models) {
+		replay(records, *model);
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/bash
+# Collects the USDT probes of a benchmark binary (see util/usdt.h) while it runs.
+#
+#   tools/usdt_trace.sh [--perf] [BINARY] [BENCHMARK ARGUMENTS...]
+#   tools/usdt_trace.sh ./a.out --benchmark_filter=clause_population
+#
+# By default, bpftrace aggregates the new_buffer:reallocate probes by layout and element size and prints the histograms
+# at exit. With --perf, the probes are recorded into perf.data instead, for `perf script` or `perf report`. Both usually
+# need root. The binary has to be built with <sys/sdt.h> available (systemtap-sdt-dev on Debian and Ubuntu,
+# systemtap-sdt-devel on Fedora) and without -DUSDT_PROBES=0.
+set -e
+set -o pipefail
+set -u
+
+MODE=bpftrace
+if [ "${1:-}" = "--perf" ]; then
+	MODE=perf
+	shift
+fi
+BINARY=${1:-./a.out}
+shift || true
+
+if ! readelf -n "$BINARY" 2>/dev/null | grep -q stapsdt; then
+	echo "$BINARY has no USDT probes; rebuild with <sys/sdt.h> installed" >&2
+	exit 1
+fi
+
+if [ "$MODE" = perf ]; then
+	perf buildid-cache --add "$BINARY"
+	perf probe -x "$BINARY" --add 'sdt_new_buffer:*' --add 'sdt_memory:*'
+	trap 'perf probe --del "sdt_new_buffer:*" --del "sdt_memory:*" >/dev/null 2>&1 || true' EXIT
+	perf record -e 'sdt_new_buffer:*' -e 'sdt_memory:*' -- "$BINARY" "$@"
+	perf report --stdio --sort event,sym
+	exit 0
+fi
+
+COMMAND="$BINARY"
+for ARGUMENT in "$@"; do
+	COMMAND="$COMMAND $(printf '%q' "$ARGUMENT")"
+done
+
+bpftrace -c "$COMMAND" -e "
+usdt:$BINARY:new_buffer:reallocate {
+	@reallocations[(int64)arg4, arg2] = count();
+	@in_place[(int64)arg4, arg2] = sum(arg3 == 1);
+	@initial[(int64)arg4, arg2] = sum(arg3 == 2);
+	@new_capacity[(int64)arg4] = hist(arg1);
+}
+usdt:$BINARY:memory:allocate { @allocations = count(); @allocated_bytes = hist(arg1); }
+usdt:$BINARY:memory:reallocate { @memory_reallocations = count(); @in_place_reallocations = sum(arg0 == arg1); }
+usdt:$BINARY:memory:deallocate { @deallocations = count(); }
+END {
+	printf(\"keys are [layout, element size]; layout is 0, -1, -2 or the number of inline elements\\n\");
+}"
@@ -0,0 +1,141 @@
+#pragma once
+
+// Accounting of the bytes allocated through `memory`, enabled by compiling with -DMEMORY_ACCOUNTING=1. Like the memory
+// manager of Z3, it enforces a soft and a hard limit; instead of throwing, it invokes a callback when the total crosses
+// one of them.
+//
+// Every thread accumulates its allocations and deallocations in a thread-local counter that is only flushed into the
+// global total once it has drifted by more than `batch_bytes`, so the common case is one add and one compare without
+// any shared cache line. Limits are checked on flushes only, which means that the total, and thereby the limit checks,
+// lag behind by less than `batch_bytes` per thread.
+//
+// Blocks are accounted by their usable size, i.e., malloc_usable_size, which is the size that memory::usable_size and
+// new_buffer::memory_usage report as well, and which every allocator that interposes malloc also has to provide.
+//
+// The accounting does not stay within 2% of a build without it wherever allocation dominates: with glibc, the two calls
+// to malloc_usable_size take an allocate/deallocate pair of 32 bytes from 17-18 ns to 24-27 ns, and simple_copy of 64
+// elements takes about 30% longer. Copies of 4096 elements and more, and push_back of 4096 elements and more, stay
+// within the run-to-run noise of about 10%.
+//
+// Only blocks that are allocated and freed through `memory` balance out. Blocks handed over to or taken from plain
+// malloc and free, e.g., with new_buffer::adopt and release, are counted on one side only.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <malloc.h>
+
+enum class memory_limit {
+	soft,
+	hard,
+};
+
+class memory_accounting {
+public:
+	// Called by the thread whose flush crossed the limit, from within memory::allocate, reallocate or deallocate and after
+	// the operation has completed. It is called once per upward crossing and must not throw; to abort, set a flag that
+	// the application polls (as Z3 does with its cancellation flag).
+	using callback_type = void (*)(memory_limit limit, std::int64_t total_bytes);
+
+	static constexpr std::int64_t batch_bytes = 1 << 16;
+
+private:
+	static constexpr std::int64_t unlimited = std::numeric_limits<std::int64_t>::max();
+
+	struct shared_state {
+		std::atomic<std::int64_t> total{0};
+		std::atomic<std::int64_t> soft_limit{unlimited};
+		std::atomic<std::int64_t> hard_limit{unlimited};
+		std::atomic<callback_type> callback{nullptr};
+		std::atomic<bool> above_soft{false};
+		std::atomic<bool> above_hard{false};
+	};
+
+	// never destroyed, so that allocations performed by destructors of other static objects can still be accounted
+	static shared_state& shared() {
+		static shared_state* const state = new shared_state();
+		return *state;
+	}
+
+	// constant initialized, so that accessing it does not need a guard
+	static std::int64_t& local() noexcept {
+		static thread_local std::int64_t delta = 0;
+		return delta;
+	}
+
+	// flushes what is left when a thread exits; registered on the first flush of a thread to keep `add` free of TLS guards,
+	// so a thread that exits before that takes less than batch_bytes with it
+	struct thread_guard {
+		~thread_guard() { flush(); }
+	};
+
+	static void check(shared_state& state, std::atomic<bool>& above, std::int64_t limit, memory_limit which, std::int64_t total) noexcept {
+		if(total > limit) {
+			if(!above.load(std::memory_order_relaxed) && !above.exchange(true, std::memory_order_relaxed)) {
+				callback_type const callback = state.callback.load(std::memory_order_acquire);
+				if(callback) {
+					callback(which, total);
+				}
+			}
+		} else if(above.load(std::memory_order_relaxed)) {
+			above.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	__attribute__((noinline, cold)) static void flush_batch() noexcept {
+		static thread_local thread_guard guard;
+		static_cast<void>(guard);
+		flush();
+	}
+
+	static void add(std::int64_t bytes) noexcept {
+		std::int64_t& delta = local();
+		delta += bytes;
+		if(delta > batch_bytes || delta < -batch_bytes) {
+			flush_batch();
+		}
+	}
+
+public:
+	// limits in bytes, 0 disables a limit
+	static void set_limits(std::size_t soft_limit, std::size_t hard_limit) noexcept {
+		shared_state& state = shared();
+		state.soft_limit.store(soft_limit == 0 ? unlimited : static_cast<std::int64_t>(soft_limit), std::memory_order_relaxed);
+		state.hard_limit.store(hard_limit == 0 ? unlimited : static_cast<std::int64_t>(hard_limit), std::memory_order_relaxed);
+	}
+
+	static void set_callback(callback_type callback) noexcept { shared().callback.store(callback, std::memory_order_release); }
+
+	// the global total, which does not include the unflushed counters of the threads
+	static std::int64_t total_bytes() noexcept { return shared().total.load(std::memory_order_relaxed); }
+
+	// publishes the counter of the calling thread, e.g., to obtain an exact total in a single-threaded program
+	static void flush() noexcept {
+		std::int64_t& delta = local();
+		if(delta == 0) {
+			return;
+		}
+		shared_state& state = shared();
+		std::int64_t const total = state.total.fetch_add(delta, std::memory_order_relaxed) + delta;
+		delta = 0;
+		check(state, state.above_soft, state.soft_limit.load(std::memory_order_relaxed), memory_limit::soft, total);
+		check(state, state.above_hard, state.hard_limit.load(std::memory_order_relaxed), memory_limit::hard, total);
+	}
+
+	static std::size_t block_size(void* ptr) noexcept {
+		return ptr ? malloc_usable_size(ptr) : 0;
+	}
+
+	// hooks for `memory`; the size of a reallocated block has to be taken before it is passed to realloc
+	static void allocate(void* ptr) noexcept { add(static_cast<std::int64_t>(block_size(ptr))); }
+
+	static void reallocate(std::size_t old_size, void* new_ptr) noexcept {
+		if(new_ptr) { // failed reallocations leave the old block intact
+			add(static_cast<std::int64_t>(block_size(new_ptr)) - static_cast<std::int64_t>(old_size));
+		}
+	}
+
+	static void deallocate(void* ptr) noexcept { add(-static_cast<std::int64_t>(block_size(ptr))); }
+};
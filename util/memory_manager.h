@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 
 // linux-specific (check for _msize for windows and malloc_size on OSX)
@@ -10,24 +11,59 @@
 #include <jemalloc/jemalloc.h>
 #endif
 
+#include "usdt.h"
+
+#if defined(TRACE_ALLOCATIONS) && TRACE_ALLOCATIONS
+#include "memory_trace.h"
+#endif
+
+#if defined(MEMORY_ACCOUNTING) && MEMORY_ACCOUNTING
+#include "memory_accounting.h"
+#endif
+
+#if defined(SAMPLE_ALLOCATIONS) && SAMPLE_ALLOCATIONS
+#include "memory_sampler.h"
+#endif
+
 
 #include <iostream>
 
 struct memory {
-	static void* allocate(std::size_t size) { return malloc(size); }
+	static void* allocate(std::size_t size) {
+		void* ptr = malloc(size);
+		on_allocate(ptr, size);
+		return ptr;
+	}
 	static void* allocate(std::size_t requested_size, std::size_t& actual_size) {
 		void* ptr = malloc(requested_size);
 		actual_size = malloc_usable_size(ptr);
+		on_allocate(ptr, requested_size);
 		return ptr;
 	}
-	static void* reallocate(void* ptr, std::size_t size) { return realloc(ptr, size); }
+	static void* reallocate(void* ptr, std::size_t size) {
+		std::size_t const old_size = accounted_size(ptr);
+		std::uintptr_t const old_address = address_of(ptr);
+		void* new_ptr = realloc(ptr, size);
+		on_reallocate(old_address, old_size, new_ptr, size);
+		return new_ptr;
+	}
 	static void* reallocate(void* ptr, std::size_t requested_size, std::size_t& actual_size) {
-		ptr = realloc(ptr, requested_size);
-		actual_size = malloc_usable_size(ptr);
-		return ptr;
+		std::size_t const old_size = accounted_size(ptr);
+		std::uintptr_t const old_address = address_of(ptr);
+		void* new_ptr = realloc(ptr, requested_size);
+		actual_size = malloc_usable_size(new_ptr);
+		on_reallocate(old_address, old_size, new_ptr, requested_size);
+		return new_ptr;
+	}
+	static std::size_t usable_size(void* ptr) {
+		return malloc_usable_size(ptr);
+	}
+	static void deallocate(void* ptr) {
+		on_deallocate(ptr);
+		free(ptr);
 	}
-	static void deallocate(void* ptr) { free(ptr); }
 	static void deallocate(void* ptr, std::size_t const size) {
+		on_deallocate(ptr);
 		#if defined(JEMALLOC) && JEMALLOC
 			sdallocx(ptr, size, 0);
 		#else
@@ -35,4 +71,93 @@ struct memory {
 			free(ptr);
 		#endif
 	}
+
+	// to be called when a block that was not allocated through `memory` is taken over, or when a block is handed out to
+	// be freed elsewhere, so that the allocation trace stays balanced
+	static void adopted(void* ptr, std::size_t size) {
+		#if defined(TRACE_ALLOCATIONS) && TRACE_ALLOCATIONS
+			memory_trace::instance().adopt(ptr, size);
+		#else
+			static_cast<void>(ptr);
+			static_cast<void>(size);
+		#endif
+	}
+	static void released(void* ptr) {
+		#if defined(TRACE_ALLOCATIONS) && TRACE_ALLOCATIONS
+			memory_trace::instance().release(ptr);
+		#else
+			static_cast<void>(ptr);
+		#endif
+	}
+
+private:
+	// The address of a block, for hooks that identify the block after realloc may have freed it. GCC traces integers
+	// that were converted from a pointer back to it and reports their uses with -Wuse-after-free, which the empty asm
+	// statement hides.
+	static std::uintptr_t address_of(void const* ptr) {
+		std::uintptr_t result = reinterpret_cast<std::uintptr_t>(ptr);
+		#if defined(__GNUC__)
+			asm("" : "+r"(result));
+		#endif
+		return result;
+	}
+	// instrumentation hooks, which compile to nothing unless enabled
+	static void on_allocate(void* ptr, std::size_t size) {
+		USDT_PROBE2(memory, allocate, ptr, size);
+		#if defined(TRACE_ALLOCATIONS) && TRACE_ALLOCATIONS
+			memory_trace::instance().allocate(ptr, size);
+		#endif
+		#if defined(SAMPLE_ALLOCATIONS) && SAMPLE_ALLOCATIONS
+			memory_sampler::instance().allocate(ptr, size);
+		#else
+			static_cast<void>(size);
+		#endif
+		#if defined(MEMORY_ACCOUNTING) && MEMORY_ACCOUNTING
+			memory_accounting::allocate(ptr);
+		#else
+			static_cast<void>(ptr);
+		#endif
+	}
+	// the size of a block before it is reallocated, as far as the accounting needs it
+	static std::size_t accounted_size(void* ptr) {
+		#if defined(MEMORY_ACCOUNTING) && MEMORY_ACCOUNTING
+			return memory_accounting::block_size(ptr);
+		#else
+			static_cast<void>(ptr);
+			return 0;
+		#endif
+	}
+	// old_address is taken before realloc, since the old pointer must not be read once realloc has freed it
+	static void on_reallocate(std::uintptr_t old_address, std::size_t old_size, void* new_ptr, std::size_t size) {
+		USDT_PROBE3(memory, reallocate, old_address, new_ptr, size);
+		#if defined(TRACE_ALLOCATIONS) && TRACE_ALLOCATIONS
+			memory_trace::instance().reallocate(old_address, new_ptr, size);
+		#endif
+		#if defined(SAMPLE_ALLOCATIONS) && SAMPLE_ALLOCATIONS
+			memory_sampler::instance().reallocate(old_address, new_ptr, size);
+		#else
+			static_cast<void>(old_address);
+			static_cast<void>(size);
+		#endif
+		#if defined(MEMORY_ACCOUNTING) && MEMORY_ACCOUNTING
+			memory_accounting::reallocate(old_size, new_ptr);
+		#else
+			static_cast<void>(old_size);
+			static_cast<void>(new_ptr);
+		#endif
+	}
+	static void on_deallocate(void* ptr) {
+		USDT_PROBE1(memory, deallocate, ptr);
+		#if defined(TRACE_ALLOCATIONS) && TRACE_ALLOCATIONS
+			memory_trace::instance().deallocate(address_of(ptr));
+		#endif
+		#if defined(SAMPLE_ALLOCATIONS) && SAMPLE_ALLOCATIONS
+			memory_sampler::instance().deallocate(address_of(ptr));
+		#endif
+		#if defined(MEMORY_ACCOUNTING) && MEMORY_ACCOUNTING
+			memory_accounting::deallocate(ptr);
+		#else
+			static_cast<void>(ptr);
+		#endif
+	}
 };
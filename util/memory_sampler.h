@@ -0,0 +1,275 @@
+#pragma once
+
+// Sampling heap profiler for the allocations performed through `memory`, enabled by compiling with
+// -DSAMPLE_ALLOCATIONS=1. As in tcmalloc, every thread samples one allocation per $MEMORY_SAMPLE_PERIOD bytes (default:
+// 512 KiB) on average, with exponentially distributed distances between the samples, so that allocations are sampled
+// with a probability proportional to their size. A backtrace is recorded for every sampled allocation, which is then
+// tracked until it is freed. The common case costs a thread-local subtraction per allocation and a load from a 256 KiB
+// filter per deallocation.
+//
+// `dump` writes a profile of the sampled allocations that are still alive; at exit, one is written to
+// $MEMORY_PROFILE_FILE (default: memory.profile). The format is picked by $MEMORY_PROFILE_FORMAT:
+// - "pprof" (default): the legacy heap profile of gperftools, which pprof scales by the sampling period itself, e.g.,
+//   `pprof -top a.out memory.profile`
+// - "folded": one line per stack of symbolized frames separated by semicolons, followed by the estimated live bytes,
+//   for flamegraph.pl or speedscope. Build with -rdynamic so that the frames can be symbolized.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+
+class memory_sampler {
+	static constexpr int max_depth = 64;
+	static constexpr std::size_t filter_size = 1 << 16;
+
+	struct stack_stats {
+		std::uint64_t live_count = 0;
+		std::uint64_t live_bytes = 0;
+		double live_estimate = 0; // live_bytes, corrected for the sampling probability
+		std::uint64_t total_count = 0;
+		std::uint64_t total_bytes = 0;
+	};
+
+	struct sample {
+		std::map<std::vector<void*>, stack_stats>::iterator stack;
+		std::size_t size;
+	};
+
+	std::mutex m_mutex;
+	std::int64_t const m_period;
+	std::map<std::vector<void*>, stack_stats> m_stacks;
+	std::unordered_map<std::uintptr_t, sample> m_samples; // by address, as the blocks may have been freed already
+	// counts the live samples per hash of their address, so that deallocations can rule out most addresses without a lock
+	std::atomic<std::uint32_t> m_filter[filter_size];
+
+	memory_sampler() : m_period(read_period()) {
+		for(auto& count : m_filter) {
+			count.store(0, std::memory_order_relaxed);
+		}
+		std::atexit([]() {
+			char const* const path = std::getenv("MEMORY_PROFILE_FILE");
+			instance().dump(path ? path : "memory.profile");
+		});
+	}
+
+	static std::int64_t read_period() {
+		char const* const text = std::getenv("MEMORY_SAMPLE_PERIOD");
+		long long const period = text ? std::strtoll(text, nullptr, 10) : 0;
+		return period > 0 ? static_cast<std::int64_t>(period) : 512 * 1024;
+	}
+
+	static std::size_t filter_index(std::uintptr_t address) noexcept {
+		return static_cast<std::size_t>((address >> 4) * 0x9E3779B97F4A7C15ull >> 48) % filter_size;
+	}
+
+	// bytes left until the next sample of this thread; constant initialized, so that accessing it does not need a guard
+	static std::int64_t& countdown() noexcept {
+		static thread_local std::int64_t bytes = 0;
+		return bytes;
+	}
+
+	// exponentially distributed with mean m_period
+	std::int64_t next_distance() noexcept {
+		static thread_local std::uint64_t state = 0;
+		if(state == 0) {
+			state = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^ reinterpret_cast<std::uintptr_t>(&state);
+			state |= 1;
+		}
+		// xorshift64*
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		double const uniform = static_cast<double>((state * 0x2545F4914F6CDD1Dull) >> 11) / 9007199254740992.0; // [0, 1)
+		return 1 + static_cast<std::int64_t>(-std::log(1 - uniform) * static_cast<double>(m_period));
+	}
+
+	// the number of bytes that a sample of `size` bytes stands for
+	double weight(std::size_t size) const noexcept {
+		double const ratio = static_cast<double>(size) / static_cast<double>(m_period);
+		return static_cast<double>(size) / -std::expm1(-ratio);
+	}
+
+	__attribute__((noinline, cold)) void sample_slow(void* ptr, std::size_t size) {
+		static thread_local bool started = false;
+		if(!started) { // the first distance of every thread is drawn instead of sampling its first allocation
+			started = true;
+			countdown() = next_distance() - static_cast<std::int64_t>(size);
+			if(countdown() >= 0) {
+				return;
+			}
+		}
+		while(countdown() < 0) {
+			countdown() += next_distance();
+		}
+
+		void* frames[max_depth];
+		int const depth = backtrace(frames, max_depth);
+		std::vector<void*> stack(frames + std::min(depth, 1), frames + depth); // without sample_slow itself
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const it = m_stacks.emplace(std::move(stack), stack_stats()).first;
+		++it->second.live_count;
+		it->second.live_bytes += size;
+		it->second.live_estimate += weight(size);
+		++it->second.total_count;
+		it->second.total_bytes += size;
+		std::uintptr_t const address = reinterpret_cast<std::uintptr_t>(ptr);
+		m_samples[address] = sample{ it, size };
+		m_filter[filter_index(address)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	__attribute__((noinline, cold)) void release_slow(std::uintptr_t address) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const it = m_samples.find(address);
+		if(it == m_samples.end()) {
+			return; // another sample with the same hash
+		}
+		stack_stats& stats = it->second.stack->second;
+		--stats.live_count;
+		stats.live_bytes -= it->second.size;
+		stats.live_estimate = stats.live_count == 0 ? 0 : stats.live_estimate - weight(it->second.size);
+		m_samples.erase(it);
+		m_filter[filter_index(address)].fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	static std::string symbolize(void* address) {
+		char text[64];
+		Dl_info info;
+		if(dladdr(address, &info) && info.dli_fname) {
+			if(info.dli_sname) {
+				int status = 0;
+				char* const demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+				std::string result = status == 0 ? demangled : info.dli_sname;
+				std::free(demangled);
+				return result;
+			}
+			char const* const slash = std::strrchr(info.dli_fname, '/');
+			std::snprintf(text, sizeof(text), "+0x%zx", static_cast<std::size_t>(static_cast<char const*>(address) - static_cast<char const*>(info.dli_fbase)));
+			return std::string(slash ? slash + 1 : info.dli_fname) + text;
+		}
+		std::snprintf(text, sizeof(text), "%p", address);
+		return text;
+	}
+
+	// expects m_mutex to be held
+	void write_pprof(std::FILE* file) const {
+		std::uint64_t live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+		for(auto const& stack : m_stacks) {
+			live_count += stack.second.live_count;
+			live_bytes += stack.second.live_bytes;
+			total_count += stack.second.total_count;
+			total_bytes += stack.second.total_bytes;
+		}
+		std::fprintf(file, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%lld\n",
+			static_cast<unsigned long long>(live_count), static_cast<unsigned long long>(live_bytes),
+			static_cast<unsigned long long>(total_count), static_cast<unsigned long long>(total_bytes), static_cast<long long>(m_period));
+		for(auto const& stack : m_stacks) {
+			std::fprintf(file, "%llu: %llu [%llu: %llu] @",
+				static_cast<unsigned long long>(stack.second.live_count), static_cast<unsigned long long>(stack.second.live_bytes),
+				static_cast<unsigned long long>(stack.second.total_count), static_cast<unsigned long long>(stack.second.total_bytes));
+			for(void* const frame : stack.first) {
+				std::fprintf(file, " %p", frame);
+			}
+			std::fprintf(file, "\n");
+		}
+		std::fprintf(file, "\nMAPPED_LIBRARIES:\n");
+		if(std::FILE* const maps = std::fopen("/proc/self/maps", "r")) {
+			char buffer[4096];
+			std::size_t read;
+			while((read = std::fread(buffer, 1, sizeof(buffer), maps)) > 0) {
+				std::fwrite(buffer, 1, read, file);
+			}
+			std::fclose(maps);
+		}
+	}
+
+	// expects m_mutex to be held
+	void write_folded(std::FILE* file) const {
+		std::unordered_map<void*, std::string> symbols;
+		for(auto const& stack : m_stacks) {
+			if(stack.second.live_count == 0) {
+				continue;
+			}
+			std::string line;
+			for(auto frame = stack.first.rbegin(); frame != stack.first.rend(); ++frame) { // outermost first
+				auto symbol = symbols.find(*frame);
+				if(symbol == symbols.end()) {
+					symbol = symbols.emplace(*frame, symbolize(*frame)).first;
+				}
+				if(!line.empty()) {
+					line += ';';
+				}
+				line += symbol->second;
+			}
+			std::fprintf(file, "%s %llu\n", line.c_str(), static_cast<unsigned long long>(std::llround(stack.second.live_estimate)));
+		}
+	}
+
+public:
+	// never destroyed, so that allocations performed by destructors of other static objects can still be sampled
+	static memory_sampler& instance() {
+		static memory_sampler* const sampler = new memory_sampler();
+		return *sampler;
+	}
+
+	std::int64_t period() const noexcept { return m_period; }
+
+	void allocate(void* ptr, std::size_t size) {
+		std::int64_t& bytes = countdown();
+		bytes -= static_cast<std::int64_t>(size);
+		if(bytes < 0 && ptr) {
+			sample_slow(ptr, size);
+		}
+	}
+
+	// blocks are passed by address, so that the hooks can run after the block has been freed without touching a dangling
+	// pointer
+	void deallocate(std::uintptr_t address) {
+		if(m_filter[filter_index(address)].load(std::memory_order_relaxed) != 0) {
+			release_slow(address);
+		}
+	}
+
+	// a reallocation is sampled like a deallocation followed by an allocation of the new size
+	void reallocate(std::uintptr_t old_address, void* new_ptr, std::size_t size) {
+		if(new_ptr == nullptr) {
+			return; // failed reallocations leave the old block intact
+		}
+		deallocate(old_address);
+		allocate(new_ptr, size);
+	}
+
+	// writes the live samples in the format given by $MEMORY_PROFILE_FORMAT, returns false if the file cannot be opened
+	bool dump(char const* path) {
+		std::FILE* const file = std::fopen(path, "w");
+		if(!file) {
+			return false;
+		}
+		char const* const format = std::getenv("MEMORY_PROFILE_FORMAT");
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(format && std::strcmp(format, "folded") == 0) {
+				write_folded(file);
+			} else {
+				write_pprof(file);
+			}
+		}
+		std::fclose(file);
+		return true;
+	}
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+// Binary trace of every allocation, reallocation and deallocation performed through `memory`. Enabled by compiling with
+// -DTRACE_ALLOCATIONS=1; the trace is written to $MEMORY_TRACE_FILE (default: memory.trace) and can be replayed with
+// tools/alloc_replay.cpp.
+//
+// Blocks that new_buffer::adopt takes over are recorded as allocated when they are adopted, unless they were allocated
+// through `memory` while tracing; blocks handed out by new_buffer::release are recorded as freed when they are released,
+// whether the caller frees them with plain free or through `memory` later on.
+//
+// File format: the 8 byte magic "MEMTRACE", a little endian uint32 version and uint32 record size, followed by
+// fixed-size records in the order in which the operations were performed.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+enum class memory_trace_op : std::uint8_t {
+	allocate = 0,
+	reallocate = 1,
+	deallocate = 2,
+};
+
+struct memory_trace_record {
+	std::uint64_t timestamp; // ns since the trace was started
+	std::uint64_t id; // allocations are numbered consecutively from 0; reallocations keep the id
+	std::uint64_t size; // requested size, 0 for deallocations
+	std::uint32_t thread; // threads are numbered consecutively from 0 in order of their first traced operation
+	memory_trace_op op;
+	std::uint8_t reserved[3];
+};
+static_assert(sizeof(memory_trace_record) == 32, "the trace format relies on records without padding");
+
+static char const memory_trace_magic[8] = { 'M', 'E', 'M', 'T', 'R', 'A', 'C', 'E' };
+static std::uint32_t const memory_trace_version = 1;
+
+class memory_trace {
+	std::mutex m_mutex;
+	std::FILE* m_file = nullptr;
+	std::chrono::steady_clock::time_point const m_start = std::chrono::steady_clock::now();
+	std::unordered_map<std::uintptr_t, std::uint64_t> m_ids; // by address, as the blocks may have been freed already
+	std::uint64_t m_next_id = 0;
+	std::atomic<std::uint32_t> m_next_thread{0};
+	std::vector<memory_trace_record> m_buffer;
+
+	memory_trace() {
+		char const* const path = std::getenv("MEMORY_TRACE_FILE");
+		m_file = std::fopen(path ? path : "memory.trace", "wb");
+		if(m_file) {
+			std::uint32_t const header[2] = { memory_trace_version, static_cast<std::uint32_t>(sizeof(memory_trace_record)) };
+			std::fwrite(memory_trace_magic, sizeof(memory_trace_magic), 1, m_file);
+			std::fwrite(header, sizeof(header), 1, m_file);
+		}
+		m_buffer.reserve(buffer_capacity);
+		std::atexit([]() { instance().close(); });
+	}
+
+	static constexpr std::size_t buffer_capacity = 1 << 14;
+
+	std::uint32_t thread_id() {
+		thread_local std::uint32_t const id = m_next_thread++;
+		return id;
+	}
+
+	void flush() {
+		if(m_file && !m_buffer.empty()) {
+			std::fwrite(m_buffer.data(), sizeof(memory_trace_record), m_buffer.size(), m_file);
+		}
+		m_buffer.clear();
+	}
+
+	// expects m_mutex to be held
+	void append(memory_trace_op op, std::uint64_t id, std::size_t size) {
+		memory_trace_record record;
+		std::memset(&record, 0, sizeof(record));
+		record.timestamp = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+		record.id = id;
+		record.size = size;
+		record.thread = thread_id();
+		record.op = op;
+		m_buffer.push_back(record);
+		if(m_buffer.size() >= buffer_capacity) {
+			flush();
+		}
+	}
+
+public:
+	// never destroyed, so that allocations performed by destructors of other static objects can still be traced
+	static memory_trace& instance() {
+		static memory_trace* const trace = new memory_trace();
+		return *trace;
+	}
+
+	void allocate(void const* ptr, std::size_t size) {
+		if(ptr == nullptr) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::uint64_t const id = m_next_id++;
+		m_ids[reinterpret_cast<std::uintptr_t>(ptr)] = id;
+		append(memory_trace_op::allocate, id, size);
+	}
+
+	// blocks are passed by address, so that the hooks can run after the block has been freed without touching a dangling
+	// pointer
+	void reallocate(std::uintptr_t old_address, void const* new_ptr, std::size_t size) {
+		if(new_ptr == nullptr) {
+			return; // failed reallocations leave the old block intact
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const it = m_ids.find(old_address);
+		if(it == m_ids.end()) {
+			return; // allocated before tracing started
+		}
+		std::uint64_t const id = it->second;
+		std::uintptr_t const new_address = reinterpret_cast<std::uintptr_t>(new_ptr);
+		if(old_address != new_address) {
+			m_ids.erase(it);
+			m_ids[new_address] = id;
+		}
+		append(memory_trace_op::reallocate, id, size);
+	}
+
+	void deallocate(std::uintptr_t address) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto const it = m_ids.find(address);
+		if(it == m_ids.end()) {
+			return;
+		}
+		append(memory_trace_op::deallocate, it->second, 0);
+		m_ids.erase(it);
+	}
+
+	// for blocks that enter or leave the control of `memory` without being allocated or freed through it, as with
+	// new_buffer::adopt and release; an adopted block that was allocated through `memory` keeps its id
+	void adopt(void const* ptr, std::size_t size) {
+		if(ptr == nullptr) {
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(m_ids.find(reinterpret_cast<std::uintptr_t>(ptr)) != m_ids.end()) {
+				return;
+			}
+		}
+		allocate(ptr, size);
+	}
+
+	void release(void const* ptr) { deallocate(reinterpret_cast<std::uintptr_t>(ptr)); }
+
+	void close() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		flush();
+		if(m_file) {
+			std::fclose(m_file);
+			m_file = nullptr;
+		}
+	}
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+// Static tracepoints (USDT) in the style of <sys/sdt.h>, which can be attached to with bpftrace or perf without
+// rebuilding, see tools/usdt_trace.sh. A probe that nothing is attached to is a single nop, and its arguments are
+// values that are in registers at the probe site anyway.
+//
+// The probes are compiled in whenever <sys/sdt.h> (systemtap-sdt-dev) is available; -DUSDT_PROBES=0 removes them and
+// -DUSDT_PROBES=1 insists on them.
+//
+// memory:allocate(ptr, size)
+// memory:reallocate(old_ptr, new_ptr, size)
+// memory:deallocate(ptr)
+// new_buffer:reallocate(old_capacity, new_capacity, element_size, in_place, layout), where in_place is 1 if the elements
+//   have not moved, 0 if they have, and 2 for the initial allocation of a buffer without elements or heap storage, and
+//   layout is the INITIAL_SIZE of the specialization (0, -1, -2 or the number of inline elements)
+
+#if !defined(USDT_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define USDT_PROBES 1
+#endif
+#endif
+
+#if defined(USDT_PROBES) && USDT_PROBES
+#include <sys/sdt.h>
+#define USDT_PROBE1(provider, name, a1) DTRACE_PROBE1(provider, name, a1)
+#define USDT_PROBE2(provider, name, a1, a2) DTRACE_PROBE2(provider, name, a1, a2)
+#define USDT_PROBE3(provider, name, a1, a2, a3) DTRACE_PROBE3(provider, name, a1, a2, a3)
+#define USDT_PROBE5(provider, name, a1, a2, a3, a4, a5) DTRACE_PROBE5(provider, name, a1, a2, a3, a4, a5)
+#else
+#define USDT_PROBE1(provider, name, a1) do { } while(0)
+#define USDT_PROBE2(provider, name, a1, a2) do { } while(0)
+#define USDT_PROBE3(provider, name, a1, a2, a3) do { } while(0)
+#define USDT_PROBE5(provider, name, a1, a2, a3, a4, a5) do { } while(0)
+#endif